@@ -10,11 +10,16 @@
 #include <random>
 
 #include "Timer.h"
+#include "Profiler.h"
 #include <rotate.h>
 #include <math.h>
 #include <execution>
 
 #include <Habitat.h>
+#include <IslandNet.h>
+#include <ImageStore.h>
+#include <Preview.h>
+#include <Snapshot.h>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/core/matx.hpp>
@@ -23,36 +28,82 @@
 #include <opencv2/imgcodecs.hpp>
 
 #include "utils.h"
-bool init_sdl(SDL_Window** window_ptr, SDL_Surface** surface_ptr, SDL_Renderer** renderer_ptr,
-                   int x_win_res, int y_win_res);
-void sdl_draw(SDL_Renderer* renderer, const SrcImage& img, void* data);
 
 int main( int argc, char* args[] ) {
     SetProcessDPIAware();
 
-    SDL_Window* window = NULL;
-    SDL_Surface* screenSurface = NULL;
-    SDL_Renderer* renderer = NULL;
-    SDL_Event event;
-
-    SDL_Window* window2 = NULL;
-    SDL_Surface* screenSurface2 = NULL;
-    SDL_Renderer* renderer2 = NULL;
-
-    init_sdl(&window, &screenSurface, &renderer, 2112/2.5, 4096/2.5);
-    init_sdl(&window2, &screenSurface2, &renderer2, 2112/2.5, 4096/2.5);
+    // best canvas and target are shown from their own thread, step() never waits on them
+    Preview preview(2112/2.5, 4096/2.5, 30);
+    preview.start();
 
     IMG_Init(IMG_INIT_PNG);
+    std::cout << "metric kernels: " << metric_isa_name(metric_isa()) << std::endl;
+
+    // Every level stays resident, so a stage switch is only a parallel re-render.
+    // Qats_reduced.pack (see pack_images) is mapped when present, otherwise the directory
+    // is decoded. Last image is the target, the rest is the library.
+    const std::vector<long long> levelBudgets = {20000, 30000, 60000, 100000000000};
+    const std::vector<uint64_t> levelGenerations = {0, 80000, 300000, 420000};
+    ImageStore store;
+    if (!store.loadPack("Qats_reduced.pack")) {
+        store.load(list_images("Qats_reduced"), levelBudgets);
+        const LoadTiming& lt = store.timing();
+        std::cout << "decoded " << lt.images << " images (" << lt.failed << " failed) in " << lt.wallMs <<
+         " ms, read " << lt.readMs << " decode " << lt.decodeMs << " resample " << lt.resampleMs << " ms" << std::endl;
+    }
+    const int levelCount = store.levelCount();
+    const int recInd = store.imageCount() - 1;
+    std::vector<std::vector<SrcImage>> library(levelCount);
+    for (int l = 0; l < levelCount; l++) {
+        library[l].assign(store.level(l)->begin(), store.level(l)->begin() + recInd);
+    }
+    std::cout << "RECONSTRUCTING " << store.path(recInd) << ", " << recInd << " images in " <<
+     store.bytes() / (1 << 20) << " MB" << std::endl;
 
-    std::vector<SrcImage> src_images;
-    load_images(20000, "Qats_reduced", src_images);
-    int recInd = src_images.size()-1;
-    SrcImage reconstructed = src_images[recInd];
-    std::cout << "RECONSTRUCTING " << reconstructed.path << std::endl;
-    std::cout << "p1 p2 p3 p4 " << (int)reconstructed.data[0] << " " << (int)reconstructed.data[1]
-     << " " << (int)reconstructed.data[2] << " " << (int)reconstructed.data[3] << " " << std::endl;
-    src_images.erase(src_images.begin() + recInd);
-    Habitat hbsim = Habitat(&reconstructed, &src_images);
+    Habitat hbsim = Habitat(&store.get(recInd, 0), &library[0]);
+    std::vector<ResolutionLevel> levels;
+    for (int l = 0; l < levelCount; l++) {
+        levels.push_back(ResolutionLevel{&store.get(recInd, l), &library[l], l < levelGenerations.size() ? levelGenerations[l] : 0});
+    }
+    hbsim.setResolutionSchedule(levels, ScheduleSettings{0, 0});
+    hbsim.enablePlacementSearch(8);
+
+    // --coordinate PORT hosts the migration coordinator and joins it,
+    // --join HOST PORT runs this process as one more island,
+    // --checkpoint PATH saves every 5000 generations, --resume PATH continues from one,
+    // --snapshots DIR dumps the best image there every 500 generations when it improved
+    IslandCoordinator* coordinator = NULL;
+    IslandWorker* worker = NULL;
+    SnapshotWriter* snapshots = NULL;
+    int migrationInterval = 500;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = args[a];
+        if (arg == "--coordinate" && a + 1 < argc) {
+            int port = atoi(args[++a]);
+            coordinator = new IslandCoordinator(port);
+            if (!coordinator->start()) {
+                std::cout << "exiting, the coordinator did not start" << std::endl;
+                delete coordinator;
+                return 1;
+            }
+            worker = new IslandWorker("127.0.0.1", port);
+        } else if (arg == "--join" && a + 2 < argc) {
+            worker = new IslandWorker(args[a + 1], atoi(args[a + 2]));
+            a += 2;
+        } else if (arg == "--checkpoint" && a + 1 < argc) {
+            hbsim.enableCheckpoints(args[++a], 5000);
+        } else if (arg == "--resume" && a + 1 < argc) {
+            hbsim.loadCheckpoint(args[++a]);
+        } else if (arg == "--snapshots" && a + 1 < argc) {
+            snapshots = new SnapshotWriter(args[++a], "png", 4);
+        }
+    }
+    if (worker && !worker->connect()) {
+        std::cout << "exiting, could not join the coordinator" << std::endl;
+        delete worker;
+        delete coordinator;
+        return 1;
+    }
 
     Timer t;
     t.start();
@@ -60,81 +111,38 @@ int main( int argc, char* args[] ) {
     for (int i = 0; i < 100000000; i++) {
         hbsim.step();
 
-        if (i == 80000) {
-            src_images.clear(); // TODO: free .data of underlying images
-            load_images(30000, "Qats_reduced", src_images);
-            reconstructed = src_images[recInd];
-            src_images.erase(src_images.begin() + recInd);
-            hbsim.reload_indiv_pointers();
+        if (worker && i % migrationInterval == 0 && worker->connected()) {
+            worker->exchange(hbsim, 2);
         }
 
-        if (i == 300000) {
-            src_images.clear(); // TODO: free .data of underlying images
-            load_images(60000, "Qats_reduced", src_images);
-            reconstructed = src_images[recInd];
-            src_images.erase(src_images.begin() + recInd);
-            hbsim.reload_indiv_pointers();
-        }
-        if (i == 420000) {
-            src_images.clear(); // TODO: free .data of underlying images
-            load_images(100000000000, "Qats_reduced", src_images);
-            reconstructed = src_images[recInd];
-            src_images.erase(src_images.begin() + recInd);
-            hbsim.reload_indiv_pointers();
-            interval = 1;
-        }
-        while (SDL_PollEvent(&event)) {
-        }
+        const SrcImage& reconstructed = store.get(recInd, hbsim.getLevel());
+        preview.publish(&reconstructed, hbsim.getBestGroup().pastedData, hbsim.getGeneration(),
+                        hbsim.getBestGroup().fitness);
+        if (preview.closed())
+            break;
         if (i % interval == 0) {
-            sdl_draw(renderer, reconstructed, (void*)hbsim.getBestGroup().pastedData);
-            sdl_draw(renderer2, reconstructed, (void*)reconstructed.data);
+            if (snapshots) {
+                snapshots->submit(reconstructed, hbsim.getBestGroup().pastedData, hbsim.getGeneration(),
+                                  hbsim.getBestGroup().fitness);
+            }
             std::cout << "currently at " << i << " " << interval << " gens took " << t.get() <<
              "\n" << "sad is " << hbsim.getBestGroup().fitness <<
-              " num images :" << hbsim.getBestGroup().individuals.size() << "\n";
+              " num images :" << hbsim.getBestGroup().genes.count << "\n";
+            if (coordinator) {
+                std::cout << "global best " << coordinator->getBestFitness() << " at level " <<
+                 coordinator->getBestLevel() << " from " <<
+                 coordinator->getWorkerCount() << " workers\n";
+            }
+            // phase breakdown, only in builds with PROFILER_ENABLED
+            profile_report(std::cout, false);
 
             t.start();
         }
 
     }
+    delete snapshots;
+    delete worker;
+    delete coordinator;
 
     return 0;
 }
-
-
-bool init_sdl(SDL_Window** window_ptr, SDL_Surface** surface_ptr, SDL_Renderer** renderer_ptr,
-            int x_win_res, int y_win_res) {
-    if( SDL_Init( SDL_INIT_VIDEO ) < 0 ) {
-        printf( "SDL could not initialize! SDL_Error: %s\n", SDL_GetError() );
-        return false;
-    }
-
-    *window_ptr = SDL_CreateWindow( "imageVimage", SDL_WINDOWPOS_UNDEFINED,
-                               SDL_WINDOWPOS_UNDEFINED, x_win_res,
-                                y_win_res, SDL_WINDOW_SHOWN );
-    if( *window_ptr == NULL ) {
-        printf( "Window could not be created! SDL_Error: %s\n", SDL_GetError() );
-        return false;
-    }
-
-    *renderer_ptr = SDL_CreateRenderer( *window_ptr, -1, SDL_RENDERER_ACCELERATED );
-
-    SDL_SetRenderDrawColor( *renderer_ptr, 0xFF, 0xFF, 0xFF, 0xFF );
-
-    *surface_ptr = SDL_GetWindowSurface( *window_ptr );
-
-    return true;
-}
-
-void sdl_draw(SDL_Renderer* renderer, const SrcImage& img, void* data) {
-    SDL_Texture *intermediate = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
-                                SDL_TEXTUREACCESS_STREAMING, img.width, img.height);
-    SDL_UpdateTexture(intermediate, NULL, data, img.pitch);
-
-    SDL_SetRenderDrawColor(renderer, 88, 88, 88, 255);
-    SDL_RenderClear(renderer);
-	SDL_RenderCopy(renderer, intermediate, NULL, NULL);
-	SDL_RenderPresent(renderer);
-
-    SDL_Delay(0);
-    SDL_DestroyTexture(intermediate);
-}
@@ -0,0 +1,508 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <csignal>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <stdlib.h>
+
+#include <tbb/global_control.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "Timer.h"
+#include "Profiler.h"
+#include "Habitat.h"
+#include "Archipelago.h"
+#include "ImageStore.h"
+#include "ImageStream.h"
+#include "Snapshot.h"
+
+// Runs one reconstruction without a display, for batch jobs on servers:
+//     headless [--config FILE] [--key value ...]
+// The config file holds "key = value" lines, '#' starts a comment, flags override it.
+// Keys (flags may use '-' for '_'):
+//     target                 image to reconstruct (required)
+//     library | pack         directory of images, or a pack_images file, the target is left out of either
+//     stream                 MB of decoded library pixels to cache, > 0 decodes the library on demand
+//                            instead of up front (library directory, one level at the first budget)
+//     levels                 pixel budgets per resolution level, comma separated
+//     level_generations      generation each level starts at, 0 leaves it to plateau detection
+//     plateau_seconds, plateau_improvement
+//     img_count, pop_size, reroll, crossover_chance, min_scale, max_scale,
+//     render_mode (painter | front_to_back), edge_weight, seed, max_images, color_guide
+//     placement_candidates, sprite_cache_mb, sprite_angle_step, sprite_scale_step
+//     threads                0 uses every core
+//     output                 best image at the end (and on Ctrl+C)
+//     snapshot_dir           best image every snapshot_interval generations when it improved,
+//     snapshot_interval      written as snapshot_format (png | ppm) on a background thread
+//     snapshot_format
+//     checkpoint, checkpoint_interval, resume
+//     time_limit             wall-clock seconds, 0 = none
+//     target_fitness         stop once best fitness is at or below, 0 = none
+//     max_generations        0 = none
+//     report_interval        seconds between progress lines
+//     profile_output         file the phase profile is appended to at every report, JSON lines
+//                            when it ends in .json, CSV otherwise (builds with PROFILER_ENABLED)
+//     islands                more than 1 runs an Archipelago of that many habitats (no checkpoints)
+//     migration_interval, migrants, topology (ring | random)
+
+// Thumbnail pixels per streamed image, all stay resident for the similarity index
+#define STREAM_THUMB_PX 256
+
+static volatile std::sig_atomic_t gStop = 0;
+
+static void on_signal(int) {
+    gStop = 1;
+}
+
+static const char* KEYS[] = {
+    "target", "library", "pack", "levels", "level_generations", "plateau_seconds", "plateau_improvement",
+    "img_count", "pop_size", "reroll", "crossover_chance", "min_scale", "max_scale", "render_mode",
+    "edge_weight", "seed", "max_images", "color_guide", "placement_candidates", "sprite_cache_mb",
+    "sprite_angle_step", "sprite_scale_step", "threads", "output", "snapshot_dir", "snapshot_interval",
+    "snapshot_format", "checkpoint", "checkpoint_interval", "resume", "time_limit", "target_fitness", "max_generations", "report_interval",
+    "profile_output", "stream", "islands", "migration_interval", "migrants", "topology"
+};
+
+static std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos)
+        return "";
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+static bool known_key(const std::string& key) {
+    for (int i = 0; i < sizeof(KEYS) / sizeof(KEYS[0]); i++) {
+        if (key == KEYS[i])
+            return true;
+    }
+    return false;
+}
+
+static bool set_option(std::map<std::string, std::string>& cfg, std::string key, const std::string& value) {
+    for (int i = 0; i < key.size(); i++) {
+        if (key[i] == '-')
+            key[i] = '_';
+    }
+    if (!known_key(key)) {
+        std::cout << "unknown option " << key << std::endl;
+        return false;
+    }
+    cfg[key] = value;
+    return true;
+}
+
+static bool read_config(const std::string& path, std::map<std::string, std::string>& cfg) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cout << "could not open config " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    for (int n = 1; std::getline(in, line); n++) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            std::cout << path << ":" << n << ": expected key = value" << std::endl;
+            return false;
+        }
+        if (!set_option(cfg, trim(line.substr(0, eq)), trim(line.substr(eq + 1))))
+            return false;
+    }
+    return true;
+}
+
+static std::string get_str(const std::map<std::string, std::string>& cfg, const std::string& key,
+                           const std::string& def) {
+    auto it = cfg.find(key);
+    return it == cfg.end() ? def : it->second;
+}
+
+static double get_num(const std::map<std::string, std::string>& cfg, const std::string& key, double def) {
+    auto it = cfg.find(key);
+    return it == cfg.end() ? def : atof(it->second.c_str());
+}
+
+template <typename T>
+static std::vector<T> get_list(const std::map<std::string, std::string>& cfg, const std::string& key,
+                               const std::vector<T>& def) {
+    auto it = cfg.find(key);
+    if (it == cfg.end())
+        return def;
+    std::vector<T> out;
+    std::stringstream ss(it->second);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        item = trim(item);
+        if (!item.empty())
+            out.push_back((T)atof(item.c_str()));
+    }
+    return out;
+}
+
+// Pack paths are as stored at packing time, so fall back to comparing the normalised
+// paths when one of the files is not reachable from here
+static bool same_file(const std::string& a, const std::string& b) {
+    std::error_code ec;
+    if (std::filesystem::equivalent(a, b, ec))
+        return true;
+    std::filesystem::path pa = std::filesystem::absolute(a, ec).lexically_normal();
+    std::filesystem::path pb = std::filesystem::absolute(b, ec).lexically_normal();
+    return !ec && pa == pb;
+}
+
+static bool write_image(const std::string& path, const SrcImage& target, const uint8_t* canvas) {
+    cv::Mat bgra(target.height, target.width, CV_8UC4, (void*)canvas, target.pitch);
+    cv::Mat bgr;
+    cv::cvtColor(bgra, bgr, cv::COLOR_BGRA2BGR);
+    if (!cv::imwrite(path, bgr)) {
+        std::cout << "could not write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static SrcImage frame_image(const PreviewFrame& frame) {
+    SrcImage img;
+    img.width = frame.width;
+    img.height = frame.height;
+    img.pitch = frame.pitch;
+    img.sad = 0;
+    img.data = (uint8_t*)frame.pixels.data();
+    return img;
+}
+
+// Islands step on their own threads, this one polls their stats. Generation limits
+// apply to the slowest island, output and snapshots take the best island's published canvas.
+static int run_islands(Archipelago& arch, double timeLimit, uint64_t targetFitness, uint64_t maxGenerations,
+                       double reportInterval, const std::string& output, SnapshotWriter* snapshots,
+                       std::ofstream& profile, bool profileJson) {
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    std::cout << "running " << arch.islandCount() << " islands" << std::endl;
+    arch.start();
+    Timer t;
+    t.start();
+    double elapsed = 0;
+    uint64_t snapshotGeneration = 0;
+    const char* reason = "interrupted";
+    while (!gStop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        int best = arch.getBestIsland();
+        IslandStats bs = arch.getStats(best);
+        uint64_t gen = UINT64_MAX;
+        float gensPerSec = 0;
+        for (int i = 0; i < arch.islandCount(); i++) {
+            IslandStats s = arch.getStats(i);
+            gen = std::min(gen, s.generation);
+            gensPerSec += s.gensPerSec;
+        }
+        if (snapshots) {
+            std::shared_ptr<const PreviewFrame> frame = arch.getBestFrame();
+            if (frame->generation != snapshotGeneration) {
+                snapshotGeneration = frame->generation;
+                snapshots->submit(frame_image(*frame), frame->pixels.data(), frame->generation, frame->fitness);
+            }
+        }
+        if (maxGenerations > 0 && gen >= maxGenerations) {
+            reason = "generation limit";
+            break;
+        }
+        if (targetFitness > 0 && bs.bestFitness <= targetFitness) {
+            reason = "fitness reached";
+            break;
+        }
+        double since = t.get() / 1e6;
+        if (timeLimit > 0 && elapsed + since >= timeLimit) {
+            reason = "time limit";
+            break;
+        }
+        if (since >= reportInterval) {
+            elapsed += since;
+            t.start();
+            std::cout << "generation " << gen << " level " << bs.level << " best " << bs.bestFitness <<
+             " (island " << best << "), " << (int)gensPerSec << " gen/s" << std::endl;
+            if (profile.is_open())
+                profile_report(profile, profileJson);
+        }
+    }
+    arch.stop();
+    elapsed += t.get() / 1e6;
+
+    std::shared_ptr<const PreviewFrame> frame = arch.getBestFrame();
+    std::cout << "stopped (" << reason << ") after " << elapsed << " s, best " << frame->fitness <<
+     " from island " << arch.getBestIsland() << " at generation " << frame->generation << std::endl;
+    if (profile.is_open())
+        profile_report(profile, profileJson);
+    if (snapshots) {
+        snapshots->submit(frame_image(*frame), frame->pixels.data(), frame->generation, frame->fitness);
+        snapshots->flush();
+        std::cout << snapshots->written() << " snapshots written, " << snapshots->dropped() << " dropped" << std::endl;
+    }
+    if (!output.empty() && !write_image(output, frame_image(*frame), frame->pixels.data()))
+        return 1;
+    return 0;
+}
+
+int main( int argc, char* args[] ) {
+    std::map<std::string, std::string> cfg;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = args[a];
+        if (arg == "--config" && a + 1 < argc) {
+            if (!read_config(args[++a], cfg))
+                return 1;
+        }
+    }
+    for (int a = 1; a < argc; a++) {
+        std::string arg = args[a];
+        if (arg == "--config") {
+            a++;
+            continue;
+        }
+        if (arg.compare(0, 2, "--") != 0 || a + 1 >= argc) {
+            std::cout << "usage: headless [--config FILE] [--key value ...]" << std::endl;
+            return 1;
+        }
+        if (!set_option(cfg, arg.substr(2), args[++a]))
+            return 1;
+    }
+
+    std::string targetPath = get_str(cfg, "target", "");
+    if (targetPath.empty()) {
+        std::cout << "no target given" << std::endl;
+        return 1;
+    }
+
+    int threads = get_num(cfg, "threads", 0);
+    std::unique_ptr<tbb::global_control> threadLimit;
+    if (threads > 0)
+        threadLimit.reset(new tbb::global_control(tbb::global_control::max_allowed_parallelism, threads));
+    std::cout << "metric kernels: " << metric_isa_name(metric_isa()) << std::endl;
+
+    // Library from a pack when given, its budgets then define the levels
+    ImageStore library;
+    std::vector<long long> levelBudgets = get_list<long long>(cfg, "levels", {20000, 30000, 60000, 100000000000});
+    std::string pack = get_str(cfg, "pack", "");
+    double streamMb = get_num(cfg, "stream", 0);
+    std::unique_ptr<ImageStream> stream;
+    if (streamMb > 0 && (!pack.empty() || get_num(cfg, "islands", 1) > 1)) {
+        std::cout << "stream works on a library directory with islands = 1" << std::endl;
+        return 1;
+    }
+    if (!pack.empty()) {
+        if (!library.loadPack(pack))
+            return 1;
+        // a pack of the directory holding the target would let it copy itself, match the stored paths
+        for (int i = library.imageCount() - 1; i >= 0; i--) {
+            if (same_file(library.path(i), targetPath)) {
+                std::cout << "leaving " << library.path(i) << " out of the library, it is the target" << std::endl;
+                library.exclude(i);
+            }
+        }
+        levelBudgets.clear();
+        for (int l = 0; l < library.levelCount(); l++) {
+            levelBudgets.push_back(library.budget(l));
+        }
+    } else {
+        std::vector<std::string> paths;
+        for (const std::string& p : list_images(get_str(cfg, "library", "Qats_reduced"))) {
+            if (!same_file(p, targetPath))
+                paths.push_back(p);
+        }
+        if (streamMb > 0) {
+            // one level, library pixels at its budget are decoded on demand
+            levelBudgets.resize(1);
+            stream.reset(new ImageStream(paths, levelBudgets[0], STREAM_THUMB_PX, streamMb * (1 << 20)));
+            if (!stream->open()) {
+                std::cout << "no library image could be read" << std::endl;
+                return 1;
+            }
+        } else {
+            library.load(paths, levelBudgets);
+            const LoadTiming& lt = library.timing();
+            std::cout << "decoded " << lt.images << " images (" << lt.failed << " failed) in " << lt.wallMs <<
+             " ms, read " << lt.readMs << " decode " << lt.decodeMs << " resample " << lt.resampleMs << " ms" << std::endl;
+        }
+    }
+    ImageStore target;
+    target.load({targetPath}, levelBudgets);
+    int imageCount = stream ? stream->imageCount() : library.imageCount();
+    if (target.imageCount() == 0 || imageCount == 0) {
+        std::cout << "nothing to reconstruct, target or library failed to load" << std::endl;
+        return 1;
+    }
+    int levelCount = stream ? 1 : library.levelCount();
+    if (stream) {
+        std::cout << "RECONSTRUCTING " << targetPath << ", " << imageCount << " images streamed through " <<
+         streamMb << " MB" << std::endl;
+    } else {
+        std::cout << "RECONSTRUCTING " << targetPath << ", " << imageCount << " images in " <<
+         library.bytes() / (1 << 20) << " MB, " << levelCount << " levels" << std::endl;
+    }
+
+    Settings st = SETTINGS_DEFAULT;
+    st.imgCount = get_num(cfg, "img_count", st.imgCount);
+    st.popSize = get_num(cfg, "pop_size", st.popSize);
+    st.reroll = get_num(cfg, "reroll", st.reroll);
+    st.crossoverChance = get_num(cfg, "crossover_chance", st.crossoverChance);
+    st.minScale = get_num(cfg, "min_scale", st.minScale);
+    st.maxScale = get_num(cfg, "max_scale", st.maxScale);
+    std::string mode = get_str(cfg, "render_mode", "painter");
+    if (mode != "painter" && mode != "front_to_back") {
+        std::cout << "render_mode is painter or front_to_back" << std::endl;
+        return 1;
+    }
+    st.renderMode = mode == "painter" ? RENDER_PAINTER : RENDER_FRONT_TO_BACK;
+    st.edgeWeight = get_num(cfg, "edge_weight", st.edgeWeight);
+    st.seed = get_num(cfg, "seed", st.seed);
+    st.maxImages = get_num(cfg, "max_images", st.maxImages);
+    st.colorGuide = get_num(cfg, "color_guide", st.colorGuide);
+
+    std::vector<uint64_t> levelGenerations = get_list<uint64_t>(cfg, "level_generations", {0, 80000, 300000, 420000});
+    std::vector<ResolutionLevel> levels;
+    for (int l = 0; l < levelCount && !stream; l++) {
+        levels.push_back(ResolutionLevel{&target.get(0, l), library.level(l),
+                                         l < levelGenerations.size() ? levelGenerations[l] : 0});
+    }
+    ScheduleSettings schedule = ScheduleSettings{(float)get_num(cfg, "plateau_seconds", 0),
+                                                 (float)get_num(cfg, "plateau_improvement", 0)};
+    int placementCandidates = get_num(cfg, "placement_candidates", 8);
+    double spriteCacheMb = get_num(cfg, "sprite_cache_mb", 0);
+    auto configure = [&](Habitat& hab) {
+        hab.setResolutionSchedule(levels, schedule);
+        hab.enablePlacementSearch(placementCandidates);
+        if (spriteCacheMb > 0) {
+            hab.enableSpriteCache(spriteCacheMb * (1 << 20), get_num(cfg, "sprite_angle_step", 0.02),
+                                  get_num(cfg, "sprite_scale_step", 0.02));
+        }
+    };
+    std::string checkpoint = get_str(cfg, "checkpoint", "");
+    std::string resume = get_str(cfg, "resume", "");
+
+    int islands = get_num(cfg, "islands", 1);
+    std::string topology = get_str(cfg, "topology", "ring");
+    if (topology != "ring" && topology != "random") {
+        std::cout << "topology is ring or random" << std::endl;
+        return 1;
+    }
+    if (islands > 1 && (!checkpoint.empty() || !resume.empty())) {
+        std::cout << "checkpoint and resume need islands = 1" << std::endl;
+        return 1;
+    }
+
+    double timeLimit = get_num(cfg, "time_limit", 0);
+    uint64_t targetFitness = get_num(cfg, "target_fitness", 0);
+    uint64_t maxGenerations = get_num(cfg, "max_generations", 0);
+    double reportInterval = get_num(cfg, "report_interval", 10);
+    std::string output = get_str(cfg, "output", "");
+    std::unique_ptr<SnapshotWriter> snapshots;
+    std::string snapshotDir = get_str(cfg, "snapshot_dir", "");
+    uint64_t snapshotInterval = get_num(cfg, "snapshot_interval", 500);
+    if (!snapshotDir.empty() && snapshotInterval > 0)
+        snapshots.reset(new SnapshotWriter(snapshotDir, get_str(cfg, "snapshot_format", "png"), 4));
+    std::string profileOutput = get_str(cfg, "profile_output", "");
+    std::ofstream profile;
+    bool profileJson = std::filesystem::path(profileOutput).extension() == ".json";
+    if (!profileOutput.empty()) {
+#ifdef PROFILER_ENABLED
+        profile.open(profileOutput, std::ios::app);
+        if (!profile)
+            std::cout << "could not open " << profileOutput << std::endl;
+#else
+        std::cout << "profile_output ignored, built without PROFILER_ENABLED" << std::endl;
+#endif
+    }
+
+    if (islands > 1) {
+        ArchipelagoSettings as = ARCHIPELAGO_DEFAULT;
+        as.islands = islands;
+        as.migrationInterval = get_num(cfg, "migration_interval", as.migrationInterval);
+        as.migrants = get_num(cfg, "migrants", as.migrants);
+        as.topology = topology == "ring" ? TOPOLOGY_RING : TOPOLOGY_RANDOM;
+        Archipelago arch(&target.get(0, 0), library.level(0), st, as);
+        for (int i = 0; i < arch.islandCount(); i++) {
+            configure(arch.getIsland(i));
+        }
+        return run_islands(arch, timeLimit, targetFitness, maxGenerations, reportInterval, output,
+                           snapshots.get(), profile, profileJson);
+    }
+
+    Habitat hbsim = stream ? Habitat(&target.get(0, 0), stream.get(), st)
+                           : Habitat(&target.get(0, 0), library.level(0), st);
+    configure(hbsim);
+    if (!checkpoint.empty())
+        hbsim.enableCheckpoints(checkpoint, get_num(cfg, "checkpoint_interval", 5000));
+    if (!resume.empty() && !hbsim.loadCheckpoint(resume))
+        return 1;
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    // wall time is summed per report, t restarts at each one
+    Timer t;
+    t.start();
+    double elapsed = 0;
+    uint64_t reportGeneration = hbsim.getGeneration();
+    const char* reason = "interrupted";
+    while (!gStop) {
+        hbsim.step();
+        uint64_t gen = hbsim.getGeneration();
+        if (snapshots && gen % snapshotInterval == 0) {
+            snapshots->submit(target.get(0, hbsim.getLevel()), hbsim.getBestGroup().pastedData, gen,
+                              hbsim.getBestGroup().fitness);
+        }
+        if (maxGenerations > 0 && gen >= maxGenerations) {
+            reason = "generation limit";
+            break;
+        }
+        if (targetFitness > 0 && hbsim.getBestGroup().fitness <= targetFitness) {
+            reason = "fitness reached";
+            break;
+        }
+        if (gen % 16 != 0)
+            continue;
+        double since = t.get() / 1e6;
+        if (timeLimit > 0 && elapsed + since >= timeLimit) {
+            reason = "time limit";
+            break;
+        }
+        if (since >= reportInterval) {
+            elapsed += since;
+            t.start();
+            std::cout << "generation " << gen << " level " << hbsim.getLevel() << " best " <<
+             hbsim.getBestGroup().fitness << ", " << (int)((gen - reportGeneration) / since) << " gen/s" << std::endl;
+            reportGeneration = gen;
+            if (profile.is_open())
+                profile_report(profile, profileJson);
+        }
+    }
+    elapsed += t.get() / 1e6;
+
+    std::cout << "stopped (" << reason << ") at generation " << hbsim.getGeneration() << " after " <<
+     elapsed << " s, best " << hbsim.getBestGroup().fitness << std::endl;
+    if (profile.is_open())
+        profile_report(profile, profileJson);
+    // periodic checkpoints can be up to checkpoint_interval generations behind
+    hbsim.writeCheckpoint();
+    hbsim.flushCheckpoints();
+    if (snapshots) {
+        snapshots->flush();
+        std::cout << snapshots->written() << " snapshots written, " << snapshots->dropped() << " dropped" << std::endl;
+    }
+    if (stream) {
+        std::cout << "stream " << stream->hits() << " hits, " << stream->misses() << " misses, " <<
+         stream->bytesResident() / (1 << 20) << " MB resident" << std::endl;
+    }
+    if (!output.empty() && !write_image(output, target.get(0, hbsim.getLevel()), hbsim.getBestGroup().pastedData))
+        return 1;
+    return 0;
+}
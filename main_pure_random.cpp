@@ -20,10 +20,9 @@
 #include "opencv2/opencv.hpp"
 #include <opencv2/imgcodecs.hpp>
 
-#include <tbb/parallel_for.h>
-#include <tbb/mutex.h>
-
 #include "utils.h"
+#include "Rng.h"
+#include "PlacementSearch.h"
 
 bool init_sdl(SDL_Window** window_ptr, SDL_Surface** surface_ptr, SDL_Renderer** renderer_ptr,
                    int x_win_res, int y_win_res);
@@ -44,63 +43,40 @@ int main( int argc, char* args[] ) {
     reconstructed.data = new uint8_t[reconstructed.width * reconstructed.height * 4];
     memset(reconstructed.data, 0xFFFFFF00, reconstructed.width * reconstructed.height*4);
     RotatePixel_t *pPstBase = static_cast<RotatePixel_t*>((void*)reconstructed.data);
-    RotatePixel_t *pDstBase = static_cast<RotatePixel_t*>((void*)src_images[recInd].data);
 
-    int best_sad;
-    int bestX;
-    int bestY;
-    float bestA;
-    float bestS;
+    PlacementSearch search(&src_images[recInd]);
+    std::vector<Placement> candidates(100);
 
-    tbb::mutex best_mutex;
+    // every placement j of iteration i gets its own stream, so runs repeat at any thread count
+    const uint32_t seed = 1;
+    Rng mainRng(seed, 0);
 
     Timer t;
     t.start();
     for (int i = 0; i < 100000000; i++) {
-        int index = rand()%(src_images.size());
+        int index = mainRng.next()%(src_images.size());
         if (index == recInd) {
             continue;
         }
         RotatePixel_t *pSrcBase = static_cast<RotatePixel_t*>((void*)src_images[index].data);
 
-        best_sad = INT_MAX;
-        tbb::parallel_for( tbb::blocked_range<int>(0, 100, 1),
-                       [&](tbb::blocked_range<int> r) {
-            for (int j = r.begin(); j < r.end(); j++) {
-                int fDstCX = rand()%(src_images[recInd].width);
-                int fDstCY = rand()%(src_images[recInd].height);
-                float fAngle = rand()%(314) / 100.0;
-                float fScale = (rand()%(1500) + 1) / 1000.0;
-                sadPair genQuality = RotateDrawClipSad(
-                        pDstBase, src_images[recInd].width, src_images[recInd].height, src_images[recInd].pitch,
-                        pSrcBase, src_images[index].width, src_images[index].height, src_images[index].pitch,
-                        pPstBase,
-                        fDstCX, fDstCY,
-                        0, 0,
-                        fAngle, fScale );
-
-
-                tbb::mutex::scoped_lock lock;
-                lock.acquire(best_mutex);
-                if (genQuality.sad1 < genQuality.sad2 && genQuality.sad1 < best_sad) {
-                    best_sad = genQuality.sad1;
-                    bestX = fDstCX;
-                    bestY = fDstCY;
-                    bestA = fAngle;
-                    bestS = fScale;
-                }
-
-                lock.release();
-            }
-        });
+        for (int j = 0; j < candidates.size(); j++) {
+            Rng rng(seed, 1 + j, i);
+            candidates[j].x = rng.next()%(src_images[recInd].width);
+            candidates[j].y = rng.next()%(src_images[recInd].height);
+            candidates[j].angle = rng.next()%(314) / 100.0;
+            candidates[j].scale = (rng.next()%(1500) + 1) / 1000.0;
+        }
+        PlacementScore best = search.best(src_images[index], reconstructed.data, candidates);
 
-        if (best_sad != INT_MAX) {
+        if (best.index >= 0 && best.gain > 0) {
+            const Placement& p = candidates[best.index];
             RotateDrawClip(
                     pPstBase, src_images[recInd].width, src_images[recInd].height, src_images[recInd].pitch,
                     pSrcBase, src_images[index].width, src_images[index].height, src_images[index].pitch,
-                    bestX, bestY,
+                    p.x, p.y,
                     0, 0,
-                    bestA, bestS );
+                    p.angle, p.scale );
         }
         if (i % 500 == 0) {
             while (SDL_PollEvent(&event)) {
@@ -0,0 +1,39 @@
+#include <iostream>
+#include <stdlib.h>
+
+#include "Timer.h"
+#include "ImageStore.h"
+
+// Builds a pack file of every image in a directory at the given pixel budgets:
+//     pack_images DIR OUT.pack [BUDGET ...]
+// Without budgets the resolution levels of main.cpp are used.
+int main( int argc, char* args[] ) {
+    if (argc < 3) {
+        std::cout << "usage: pack_images DIR OUT.pack [BUDGET ...]" << std::endl;
+        return 1;
+    }
+    std::vector<long long> budgets;
+    for (int a = 3; a < argc; a++) {
+        budgets.push_back(atoll(args[a]));
+    }
+    if (budgets.empty())
+        budgets = {20000, 30000, 60000, 100000000000};
+
+    Timer t;
+    t.start();
+    ImageStore store;
+    if (!store.load(list_images(args[1]), budgets)) {
+        std::cout << "no images loaded from " << args[1] << std::endl;
+        return 1;
+    }
+    const LoadTiming& lt = store.timing();
+    std::cout << "decoded " << store.imageCount() << " images in " << t.get() / 1000 << " ms, read " <<
+     lt.readMs << " decode " << lt.decodeMs << " resample " << lt.resampleMs << " ms" << std::endl;
+
+    t.start();
+    if (!store.savePack(args[2]))
+        return 1;
+    std::cout << "wrote " << store.bytes() / (1 << 20) << " MB of pixels to " << args[2] <<
+     " in " << t.get() / 1000 << " ms" << std::endl;
+    return 0;
+}
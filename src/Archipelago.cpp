@@ -0,0 +1,193 @@
+#include "Archipelago.h"
+#include "Timer.h"
+#include <algorithm>
+
+struct Archipelago::Island {
+    std::unique_ptr<Habitat> habitat;
+    std::thread thread;
+    std::atomic<uint64_t> generation{0};
+    std::atomic<int> level{0};
+    std::atomic<uint64_t> bestFitness{UINT64_MAX};
+    std::atomic<uint64_t> migrantsIn{0};
+    std::atomic<uint64_t> migrantsOut{0};
+    std::atomic<float> gensPerSec{0};
+    std::shared_ptr<const std::vector<Individual>> best; // atomic_load/atomic_store only
+    std::shared_ptr<const PreviewFrame> frame;          // same
+};
+
+Archipelago::Archipelago(const SrcImage* reconstructionImage, const std::vector<SrcImage>* refImages,
+                         Settings settings, ArchipelagoSettings archSettings) {
+    mArch = archSettings;
+    mArch.islands = std::max(mArch.islands, 1);
+    mArch.migrationInterval = std::max(mArch.migrationInterval, 1);
+    mSeed = settings.seed;
+    mStop = false;
+    mRunning = false;
+
+    int n = mArch.islands;
+    for (int i = 0; i < n; i++) {
+        Settings islandSettings = settings;
+        islandSettings.seed = settings.seed + i;
+
+        mIslands.emplace_back(new Island());
+        if (i == 0) {
+            mIslands[i]->habitat.reset(new Habitat(reconstructionImage, refImages, islandSettings));
+        } else {
+            // same library, so the first island's similarity index serves every island
+            mIslands[i]->habitat.reset(new Habitat(reconstructionImage, refImages, islandSettings,
+                                                   mIslands[0]->habitat->getLibraryIndex()));
+        }
+        mIslands[i]->bestFitness = mIslands[i]->habitat->getBestGroup().fitness;
+        publish(i);
+    }
+
+    mMailbox.reset(new std::atomic<Migration*>[n * n]);
+    for (int i = 0; i < n * n; i++) {
+        mMailbox[i] = nullptr;
+    }
+}
+
+Archipelago::~Archipelago() {
+    stop();
+    for (int i = 0; i < mArch.islands * mArch.islands; i++) {
+        delete mMailbox[i].exchange(nullptr);
+    }
+}
+
+void Archipelago::start() {
+    if (mRunning)
+        return;
+    mStop = false;
+    mRunning = true;
+    for (int i = 0; i < mIslands.size(); i++) {
+        mIslands[i]->thread = std::thread(&Archipelago::run, this, i);
+    }
+}
+
+void Archipelago::stop() {
+    if (!mRunning)
+        return;
+    mStop = true;
+    for (int i = 0; i < mIslands.size(); i++) {
+        mIslands[i]->thread.join();
+    }
+    mRunning = false;
+}
+
+bool Archipelago::running() {
+    return mRunning;
+}
+
+int Archipelago::islandCount() {
+    return mIslands.size();
+}
+
+IslandStats Archipelago::getStats(int island) {
+    Island& isl = *mIslands[island];
+    return IslandStats{isl.generation, isl.level, isl.bestFitness, isl.migrantsIn, isl.migrantsOut, isl.gensPerSec};
+}
+
+int Archipelago::getBestIsland() {
+    int best = 0;
+    for (int i = 1; i < mIslands.size(); i++) {
+        int level = mIslands[i]->level, bestLevel = mIslands[best]->level;
+        if (level > bestLevel || (level == bestLevel && mIslands[i]->bestFitness < mIslands[best]->bestFitness))
+            best = i;
+    }
+    return best;
+}
+
+std::vector<Individual> Archipelago::getBestGenes() {
+    return *std::atomic_load(&mIslands[getBestIsland()]->best);
+}
+
+std::shared_ptr<const PreviewFrame> Archipelago::getBestFrame() {
+    return std::atomic_load(&mIslands[getBestIsland()]->frame);
+}
+
+Habitat& Archipelago::getIsland(int island) {
+    return *mIslands[island]->habitat;
+}
+
+void Archipelago::run(int id) {
+    Island& isl = *mIslands[id];
+    Habitat& hab = *isl.habitat;
+    uint64_t startGen = hab.getGeneration();
+    Timer timer;
+    timer.start();
+
+    while (!mStop.load(std::memory_order_relaxed)) {
+        hab.step();
+        uint64_t gen = hab.getGeneration();
+
+        if (gen % mArch.migrationInterval == 0) {
+            receive(id);
+            send(id, gen);
+            publish(id);
+        }
+
+        isl.generation.store(gen, std::memory_order_relaxed);
+        isl.level.store(hab.getLevel(), std::memory_order_relaxed);
+        isl.bestFitness.store(hab.getBestGroup().fitness, std::memory_order_relaxed);
+        int64_t us = timer.get();
+        if (us > 0)
+            isl.gensPerSec.store((gen - startGen) * 1e6f / us, std::memory_order_relaxed);
+    }
+    publish(id);
+}
+
+void Archipelago::receive(int id) {
+    int n = mArch.islands;
+    for (int src = 0; src < n; src++) {
+        Migration* m = mMailbox[id * n + src].exchange(nullptr, std::memory_order_acquire);
+        if (m == nullptr)
+            continue;
+        for (int i = 0; i < m->size(); i++) {
+            mIslands[id]->habitat->immigrate((*m)[i]);
+        }
+        mIslands[id]->migrantsIn += m->size();
+        delete m;
+    }
+}
+
+void Archipelago::send(int id, uint64_t generation) {
+    int n = mArch.islands;
+    if (n < 2 || mArch.migrants <= 0)
+        return;
+
+    int dst;
+    if (mArch.topology == TOPOLOGY_RING) {
+        dst = (id + 1) % n;
+    } else {
+        Rng rng(mSeed, id, generation);
+        dst = rng.next() % (n - 1);
+        if (dst >= id)
+            dst++;
+    }
+
+    Migration* m = new Migration(mIslands[id]->habitat->topGenomes(mArch.migrants));
+    mIslands[id]->migrantsOut += m->size();
+    // Destination has not read the previous one yet, newer migrants supersede it
+    delete mMailbox[dst * n + id].exchange(m, std::memory_order_acq_rel);
+}
+
+void Archipelago::publish(int id) {
+    Habitat& hab = *mIslands[id]->habitat;
+    std::vector<std::vector<Individual>> top = hab.topGenomes(1);
+    std::shared_ptr<const std::vector<Individual>> best =
+        std::make_shared<const std::vector<Individual>>(top.empty() ? std::vector<Individual>() : top[0]);
+
+    // Rendered here, on the thread that owns the habitat, as a level change frees
+    // and replaces the target and library images a reader would draw from
+    const SrcImage* target = hab.getReconstructionImage();
+    std::shared_ptr<PreviewFrame> frame = std::make_shared<PreviewFrame>();
+    frame->width = target->width;
+    frame->height = target->height;
+    frame->pitch = target->pitch;
+    frame->generation = hab.getGeneration();
+    frame->pixels.resize((size_t)target->pitch * target->height);
+    frame->fitness = hab.renderGenes(*best, frame->pixels.data());
+
+    std::atomic_store(&mIslands[id]->best, best);
+    std::atomic_store(&mIslands[id]->frame, std::shared_ptr<const PreviewFrame>(frame));
+}
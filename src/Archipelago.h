@@ -0,0 +1,80 @@
+#ifndef ARCHIPELAGO_H
+#define ARCHIPELAGO_H
+
+#include "Habitat.h"
+#include "Preview.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define ARCHIPELAGO_DEFAULT ArchipelagoSettings{4, 200, 2, TOPOLOGY_RING}
+
+enum MigrationTopology {
+    TOPOLOGY_RING,   // island i sends to i + 1
+    TOPOLOGY_RANDOM  // each exchange picks a random other island
+};
+
+struct ArchipelagoSettings {
+    int islands;
+    int migrationInterval; // generations between exchanges
+    int migrants;          // best groups sent per exchange
+    MigrationTopology topology;
+};
+
+struct IslandStats {
+    uint64_t generation;
+    int level;
+    uint64_t bestFitness;
+    uint64_t migrantsIn;
+    uint64_t migrantsOut;
+    float gensPerSec;
+};
+
+// Runs independent Habitats on dedicated threads against the same read-only
+// target and library, sharing one LibraryIndex. Every migrationInterval generations
+// each island takes its immigrants, posts its best groups to a neighbour and publishes
+// its best genes and canvas. Mailboxes are one atomic slot per (destination, source)
+// pair; an unread migration is replaced by a newer one.
+class Archipelago
+{
+    public:
+        Archipelago(const SrcImage* reconstructionImage, const std::vector<SrcImage>* refImages,
+                    Settings settings, ArchipelagoSettings archSettings);
+        virtual ~Archipelago();
+
+        void start();
+        void stop();
+        bool running();
+
+        int islandCount();
+        IslandStats getStats(int island);
+        // Highest resolution level first, fitness is only comparable within a level
+        int getBestIsland();
+        // Genes of the best group as of its island's last exchange
+        std::vector<Individual> getBestGenes();
+        // Canvas of those genes, rendered by the island's own thread so it is safe while
+        // running; sized by the island's level at the time
+        std::shared_ptr<const PreviewFrame> getBestFrame();
+
+        // Islands must not be stepped or reloaded while running
+        Habitat& getIsland(int island);
+
+    private:
+        struct Island;
+        typedef std::vector<std::vector<Individual>> Migration;
+
+        void run(int id);
+        void receive(int id);
+        void send(int id, uint64_t generation);
+        void publish(int id);
+
+        std::vector<std::unique_ptr<Island>> mIslands;
+        std::unique_ptr<std::atomic<Migration*>[]> mMailbox;
+        ArchipelagoSettings mArch;
+        uint32_t mSeed;
+        std::atomic<bool> mStop;
+        bool mRunning;
+};
+
+#endif // ARCHIPELAGO_H
@@ -0,0 +1,84 @@
+#include "Checkpoint.h"
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+CheckpointWriter::CheckpointWriter(const std::string& path) {
+    mPath = path;
+    mHasPending = false;
+    mBusy = false;
+    mStop = false;
+    mWritten = 0;
+    mThread = std::thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mCond.notify_all();
+    mThread.join();
+}
+
+void CheckpointWriter::submit(std::vector<uint8_t>& snapshot) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPending.swap(snapshot);
+        mHasPending = true;
+    }
+    mCond.notify_all();
+}
+
+void CheckpointWriter::flush() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCond.wait(lock, [&] { return !mHasPending && !mBusy; });
+}
+
+uint64_t CheckpointWriter::written() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mWritten;
+}
+
+void CheckpointWriter::run() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCond.wait(lock, [&] { return mHasPending || mStop; });
+        if (!mHasPending)
+            break;
+
+        mWriting.swap(mPending);
+        mHasPending = false;
+        mBusy = true;
+        lock.unlock();
+
+        bool ok = writeFile(mWriting);
+
+        lock.lock();
+        mBusy = false;
+        if (ok)
+            mWritten++;
+        mCond.notify_all();
+    }
+}
+
+bool CheckpointWriter::writeFile(const std::vector<uint8_t>& data) {
+    std::string tmp = mPath + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (f == NULL) {
+        std::cout << "could not write checkpoint " << tmp << std::endl;
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = fflush(f) == 0 && ok;
+    ok = fclose(f) == 0 && ok;
+
+    std::error_code ec;
+    if (ok)
+        std::filesystem::rename(tmp, mPath, ec);
+    if (!ok || ec) {
+        std::cout << "could not write checkpoint " << mPath << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CHECKPOINT_MAGIC 0x50434947 // "GICP"
+#define CHECKPOINT_VERSION 3 // 2 adds resolution level, 3 colour guidance
+
+// Writes snapshots to path on a background thread. submit() swaps the caller's
+// buffer with the pending one, so the caller never waits on disk. A snapshot that
+// was not picked up yet is replaced by the newer one. Files are written to
+// path.tmp and renamed, so path always holds a complete checkpoint.
+class CheckpointWriter
+{
+    public:
+        CheckpointWriter(const std::string& path);
+        virtual ~CheckpointWriter(); // writes what is pending
+
+        // Takes snapshot contents, leaves a recycled buffer in its place
+        void submit(std::vector<uint8_t>& snapshot);
+        // Blocks until every submitted snapshot is on disk
+        void flush();
+
+        const std::string& path() const { return mPath; }
+        uint64_t written();
+
+    private:
+        void run();
+        bool writeFile(const std::vector<uint8_t>& data);
+
+        std::string mPath;
+        std::thread mThread;
+        std::mutex mMutex;
+        std::condition_variable mCond;
+        std::vector<uint8_t> mPending;
+        std::vector<uint8_t> mWriting;
+        bool mHasPending;
+        bool mBusy;
+        bool mStop;
+        uint64_t mWritten;
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,38 @@
+#include "Genome.h"
+#include <immintrin.h>
+
+static const int GENE_ARRAYS = 5; // imgID, xp, yp, angle, scale
+
+GenomeArena::GenomeArena() : mSlab(NULL), mBuffers(0), mCapacity(0), mArrayBytes(0) {
+
+}
+
+GenomeArena::~GenomeArena() {
+    if (mSlab)
+        _mm_free(mSlab);
+}
+
+void GenomeArena::init(int buffers, int capacity) {
+    if (mSlab)
+        _mm_free(mSlab);
+
+    mBuffers = buffers;
+    mCapacity = capacity;
+    // every array starts on its own cache line
+    mArrayBytes = ((capacity * sizeof(float) + 63) / 64) * 64;
+    mSlab = (uint8_t*)_mm_malloc(mArrayBytes * GENE_ARRAYS * buffers, 64);
+}
+
+Genome GenomeArena::view(int b) {
+    uint8_t* base = mSlab + mArrayBytes * GENE_ARRAYS * b;
+
+    Genome g;
+    g.count = 0;
+    g.capacity = mCapacity;
+    g.imgID = (int32_t*)(base);
+    g.xp = (float*)(base + mArrayBytes);
+    g.yp = (float*)(base + mArrayBytes * 2);
+    g.angle = (float*)(base + mArrayBytes * 3);
+    g.scale = (float*)(base + mArrayBytes * 4);
+    return g;
+}
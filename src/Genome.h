@@ -0,0 +1,93 @@
+#ifndef GENOME_H
+#define GENOME_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+struct Individual {
+    int imgID;
+    float xp; //xpercent
+    float yp; //ypercent
+    float angle;
+    float scale;
+};
+
+// Genes of one group in structure-of-arrays layout.
+// Only a view, memory is owned by GenomeArena, so copying a Genome copies pointers.
+struct Genome {
+    int count;
+    int capacity;
+    int32_t* imgID;
+    float* xp;
+    float* yp;
+    float* angle;
+    float* scale;
+
+    Individual get(int i) const {
+        return Individual{imgID[i], xp[i], yp[i], angle[i], scale[i]};
+    }
+
+    void set(int i, const Individual& indiv) {
+        imgID[i] = indiv.imgID;
+        xp[i] = indiv.xp;
+        yp[i] = indiv.yp;
+        angle[i] = indiv.angle;
+        scale[i] = indiv.scale;
+    }
+
+    bool same(int i, const Genome& other, int j) const {
+        return imgID[i] == other.imgID[j] && xp[i] == other.xp[j] && yp[i] == other.yp[j]
+                && angle[i] == other.angle[j] && scale[i] == other.scale[j];
+    }
+
+    // false when at capacity
+    bool push_back(const Individual& indiv) {
+        if (count >= capacity)
+            return false;
+        set(count++, indiv);
+        return true;
+    }
+
+    void erase(int i) {
+        size_t n = count - i - 1;
+        memmove(imgID + i, imgID + i + 1, n * sizeof(int32_t));
+        memmove(xp + i, xp + i + 1, n * sizeof(float));
+        memmove(yp + i, yp + i + 1, n * sizeof(float));
+        memmove(angle + i, angle + i + 1, n * sizeof(float));
+        memmove(scale + i, scale + i + 1, n * sizeof(float));
+        count--;
+    }
+
+    void copyFrom(const Genome& other) {
+        count = other.count < capacity ? other.count : capacity;
+        memcpy(imgID, other.imgID, count * sizeof(int32_t));
+        memcpy(xp, other.xp, count * sizeof(float));
+        memcpy(yp, other.yp, count * sizeof(float));
+        memcpy(angle, other.angle, count * sizeof(float));
+        memcpy(scale, other.scale, count * sizeof(float));
+    }
+};
+
+// One 64-byte aligned slab holding gene arrays of a fixed number of genome buffers,
+// each with the same capacity. Allocated once, genomes never allocate afterwards.
+class GenomeArena
+{
+    public:
+        GenomeArena();
+        virtual ~GenomeArena();
+
+        void init(int buffers, int capacity);
+        // Empty genome backed by buffer b
+        Genome view(int b);
+
+    private:
+        uint8_t* mSlab;
+        int mBuffers;
+        int mCapacity;
+        size_t mArrayBytes;
+
+        GenomeArena(const GenomeArena&);
+        GenomeArena& operator=(const GenomeArena&);
+};
+
+#endif // GENOME_H
@@ -0,0 +1,84 @@
+#include "GenomeWire.h"
+
+void wire_put_u32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t)(v >> (i * 8)));
+    }
+}
+
+void wire_put_u64(std::vector<uint8_t>& out, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        out.push_back((uint8_t)(v >> (i * 8)));
+    }
+}
+
+void wire_put_f32(std::vector<uint8_t>& out, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, 4);
+    wire_put_u32(out, bits);
+}
+
+void wire_put_genes(std::vector<uint8_t>& out, const std::vector<Individual>& genes) {
+    out.reserve(out.size() + 4 + genes.size() * 20);
+    wire_put_u32(out, genes.size());
+    for (int i = 0; i < genes.size(); i++) {
+        wire_put_u32(out, (uint32_t)genes[i].imgID);
+        wire_put_f32(out, genes[i].xp);
+        wire_put_f32(out, genes[i].yp);
+        wire_put_f32(out, genes[i].angle);
+        wire_put_f32(out, genes[i].scale);
+    }
+}
+
+bool wire_get_u32(const uint8_t* data, size_t size, size_t* pPos, uint32_t* v) {
+    if (*pPos > size || size - *pPos < 4)
+        return false;
+    const uint8_t* p = data + *pPos;
+    *v = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    *pPos += 4;
+    return true;
+}
+
+bool wire_get_u64(const uint8_t* data, size_t size, size_t* pPos, uint64_t* v) {
+    uint32_t lo, hi;
+    if (!wire_get_u32(data, size, pPos, &lo) || !wire_get_u32(data, size, pPos, &hi))
+        return false;
+    *v = lo | ((uint64_t)hi << 32);
+    return true;
+}
+
+bool wire_get_f32(const uint8_t* data, size_t size, size_t* pPos, float* v) {
+    uint32_t bits;
+    if (!wire_get_u32(data, size, pPos, &bits))
+        return false;
+    memcpy(v, &bits, 4);
+    return true;
+}
+
+bool wire_get_genes(const uint8_t* data, size_t size, size_t* pPos, std::vector<Individual>& genes) {
+    uint32_t count;
+    if (!wire_get_u32(data, size, pPos, &count))
+        return false;
+    if (count > (size - *pPos) / 20)
+        return false;
+
+    genes.resize(count);
+    for (int i = 0; i < count; i++) {
+        uint32_t id;
+        wire_get_u32(data, size, pPos, &id);
+        genes[i].imgID = (int32_t)id;
+        wire_get_f32(data, size, pPos, &genes[i].xp);
+        wire_get_f32(data, size, pPos, &genes[i].yp);
+        wire_get_f32(data, size, pPos, &genes[i].angle);
+        wire_get_f32(data, size, pPos, &genes[i].scale);
+    }
+    return true;
+}
+
+uint64_t wire_checksum(const uint8_t* data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ data[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
@@ -0,0 +1,22 @@
+#ifndef GENOMEWIRE_H
+#define GENOMEWIRE_H
+#include "Genome.h"
+#include <vector>
+
+// Little-endian byte encoding shared by network migration and checkpoints.
+// Genes are 20 bytes each: imgID, xp, yp, angle, scale. Canvases are never encoded.
+void wire_put_u32(std::vector<uint8_t>& out, uint32_t v);
+void wire_put_u64(std::vector<uint8_t>& out, uint64_t v);
+void wire_put_f32(std::vector<uint8_t>& out, float v);
+void wire_put_genes(std::vector<uint8_t>& out, const std::vector<Individual>& genes);
+
+// Readers advance *pPos, return false on truncated input
+bool wire_get_u32(const uint8_t* data, size_t size, size_t* pPos, uint32_t* v);
+bool wire_get_u64(const uint8_t* data, size_t size, size_t* pPos, uint64_t* v);
+bool wire_get_f32(const uint8_t* data, size_t size, size_t* pPos, float* v);
+bool wire_get_genes(const uint8_t* data, size_t size, size_t* pPos, std::vector<Individual>& genes);
+
+// FNV-1a, detects torn or truncated files
+uint64_t wire_checksum(const uint8_t* data, size_t size);
+
+#endif // GENOMEWIRE_H
@@ -1,31 +1,85 @@
 #include "Habitat.h"
 #include "rotate.h"
+#include "SpriteCache.h"
+#include "edges.h"
+#include "Checkpoint.h"
+#include "GenomeWire.h"
+#include "MappedFile.h"
+#include "ImageStream.h"
+#include "PlacementSearch.h"
+#include "Profiler.h"
 #include <string.h>
 #include <algorithm>
 #include <random>
 #include <math.h>
 #include <execution>
 #include <iostream>
+#include <climits>
+#include <numeric>
 
 bool cmp(const PopulationGroup& a, const PopulationGroup& b) {
 	return a.fitness < b.fitness;
 }
 
+// Rng stream namespaces, low bits hold population slot
+static const uint64_t STREAM_INIT = 1ULL << 32;
+static const uint64_t STREAM_STEP = 2ULL << 32;
+
+// images guided selection picks from at random
+static const int GUIDE_CANDIDATES = 8;
+
+static const Rect EMPTY_RECT = Rect{INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+
+static bool rect_empty(const Rect& r) {
+    return r.minx > r.maxx || r.miny > r.maxy;
+}
+
+static Rect rect_union(const Rect& a, const Rect& b) {
+    if (rect_empty(a))
+        return b;
+    if (rect_empty(b))
+        return a;
+    return Rect{std::min(a.minx, b.minx), std::min(a.miny, b.miny),
+                std::max(a.maxx, b.maxx), std::max(a.maxy, b.maxy)};
+}
+
+
 Habitat::Habitat(const SrcImage* reconstructionImage, const std::vector<SrcImage>* refImages)
         : Habitat(reconstructionImage, refImages, SETTINGS_DEFAULT) {
 }
 
-Habitat::Habitat(const SrcImage* reconstructionImage, const std::vector<SrcImage>* refImages, Settings settings) {
+Habitat::Habitat(const SrcImage* reconstructionImage, const std::vector<SrcImage>* refImages, Settings settings)
+        : Habitat(reconstructionImage, refImages, settings, NULL, nullptr) {
+}
+
+Habitat::Habitat(const SrcImage* reconstructionImage, ImageStream* stream, Settings settings)
+        : Habitat(reconstructionImage, stream->metadata(), settings, stream, nullptr) {
+}
+
+Habitat::Habitat(const SrcImage* reconstructionImage, const std::vector<SrcImage>* refImages, Settings settings,
+                 std::shared_ptr<const LibraryIndex> index)
+        : Habitat(reconstructionImage, refImages, settings, NULL, index) {
+}
+
+Habitat::Habitat(const SrcImage* reconstructionImage, const std::vector<SrcImage>* refImages, Settings settings,
+                 ImageStream* stream, std::shared_ptr<const LibraryIndex> index) {
     mRefImages = refImages;
+    mStream = stream;
     mReconstructionImage = reconstructionImage;
-    uint8_t* recGrey = to_greyscale(reconstructionImage->data, reconstructionImage->width,
-                            reconstructionImage->height, reconstructionImage->pitch);
-    mRecSobel = SobelSimd(recGrey, reconstructionImage->width,
-                        reconstructionImage->height, reconstructionImage->width);
-    delete[] recGrey;
+    mRecSobel = NULL;
+    prepare_target();
     mSettings = settings;
+    mGeneration = 0;
+    mCheckpointInterval = 0;
+    mPlacementCandidates = 0;
+    mSchedule = ScheduleSettings{0, 0};
+    mLevel = 0;
+    mPlateauFitness = UINT64_MAX;
+    // guided initial individuals need the colour index
+    mIndex = index;
+    if (!mIndex)
+        calculateClosest();
     init_pop();
-    calculateClosest();
 
     /*
     std::vector<int> indexes;
@@ -39,181 +93,873 @@ Habitat::Habitat(const SrcImage* reconstructionImage, const std::vector<SrcImage
 }
 
 void Habitat::step() {
-    std::sort(mPopulation.begin(), mPopulation.end(), cmp);
+    PROFILE_SCOPE(PROF_STEP);
+    {
+        PROFILE_SCOPE(PROF_SORT);
+        std::sort(mPopulation.begin(), mPopulation.end(), cmp);
+    }
 
     std::vector<int> indexes;
-    for(int i=0; i<mSettings.popSize; i++) {
-		if(i>(mSettings.popSize - ceil(mSettings.popSize * mSettings.reroll) - 1)) {
-            indexes.push_back(i);
+    {
+        PROFILE_SCOPE(PROF_SELECTION);
+        if (mStream && mGeneration % 32 == 0)
+            prefetchElites();
+        for(int i=0; i<mSettings.popSize; i++) {
+            if(i>(mSettings.popSize - ceil(mSettings.popSize * mSettings.reroll) - 1)) {
+                indexes.push_back(i);
+            }
         }
     }
 
     std::for_each(std::execution::par_unseq, indexes.begin(), indexes.end(), [&](int i) {
-        if(rand()%100 < mSettings.crossoverChance) {
-            int ind1 = rand() % (int)(mSettings.popSize - ceil(mSettings.popSize * mSettings.reroll) - 1);
-            int ind2 = rand() % (int)(mSettings.popSize - ceil(mSettings.popSize * mSettings.reroll) - 1);
-            crossover(mPopulation[ind1], mPopulation[ind2], mPopulation[i]);
+        Rng rng(mSettings.seed, STREAM_STEP | i, mGeneration);
+        Rect dirty;
+        bool added = false;
+        if(rng.next()%100 < mSettings.crossoverChance) {
+            int ind1 = rng.next() % (int)(mSettings.popSize - ceil(mSettings.popSize * mSettings.reroll) - 1);
+            int ind2 = rng.next() % (int)(mSettings.popSize - ceil(mSettings.popSize * mSettings.reroll) - 1);
+            PROFILE_SCOPE(PROF_CROSSOVER);
+            dirty = crossover(mPopulation[ind1], mPopulation[ind2], mPopulation[i], rng);
         } else {
-            mutate(mPopulation[i]);
+            PROFILE_SCOPE(PROF_MUTATE);
+            dirty = mutate(mPopulation[i], rng, &added);
         }
 
-        drawComputeFit(mPopulation[i]);
+        PROFILE_SCOPE(PROF_EVALUATE);
+        PROFILE_COUNT(PROF_EVALUATIONS, 1);
+        if (added)
+            drawTopComputeFit(mPopulation[i], dirty);
+        else
+            drawComputeFit(mPopulation[i], dirty);
     });
+
+    mGeneration++;
+    PROFILE_COUNT(PROF_GENERATIONS, 1);
+    updateSchedule();
+
+    if (mCheckpoint && mGeneration % mCheckpointInterval == 0) {
+        PROFILE_SCOPE(PROF_CHECKPOINT);
+        writeCheckpoint();
+    }
 }
 
 const PopulationGroup& Habitat::getBestGroup() {
     return mPopulation[0];
 }
 
-void Habitat::init_pop() {
+uint64_t Habitat::getGeneration() {
+    return mGeneration;
+}
+
+std::vector<std::vector<Individual>> Habitat::topGenomes(int k, std::vector<uint64_t>* pFitness) {
+    std::vector<int> order(mPopulation.size());
+    for (int i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    k = std::min(k, (int)order.size());
+    std::partial_sort(order.begin(), order.begin() + k, order.end(), [&](int a, int b) {
+        return mPopulation[a].fitness < mPopulation[b].fitness;
+    });
+
+    std::vector<std::vector<Individual>> out(k);
+    if (pFitness)
+        pFitness->resize(k);
+    for (int i = 0; i < k; i++) {
+        if (pFitness)
+            (*pFitness)[i] = mPopulation[order[i]].fitness;
+        const Genome& genes = mPopulation[order[i]].genes;
+        for (int j = 0; j < genes.count; j++) {
+            out[i].push_back(genes.get(j));
+        }
+    }
+    return out;
+}
+
+void Habitat::immigrate(const std::vector<Individual>& genes) {
+    PopulationGroup& worst = *std::max_element(mPopulation.begin(), mPopulation.end(), cmp);
+    worst.genes.count = 0;
+    for (int i = 0; i < genes.size(); i++) {
+        if (genes[i].imgID < 0 || genes[i].imgID >= mRefImages->size())
+            continue;
+        worst.genes.push_back(genes[i]);
+    }
+    drawComputeFit(worst);
+}
+
+uint64_t Habitat::renderGenes(const std::vector<Individual>& genes, uint8_t* canvas) {
+    GenomeArena arena;
+    arena.init(1, std::max((int)genes.size(), 1));
+
+    PopulationGroup grp;
+    grp.genes = arena.view(0);
+    grp.spare = grp.genes;
+    grp.pastedData = canvas;
+    for (int i = 0; i < genes.size(); i++) {
+        if (genes[i].imgID >= 0 && genes[i].imgID < mRefImages->size())
+            grp.genes.push_back(genes[i]);
+    }
+    drawComputeFit(grp);
+    return grp.fitness;
+}
+
+void Habitat::alloc_pop() {
+    for (int i = 0; i < mPopulation.size(); i++) {
+        delete[] mPopulation[i].pastedData;
+    }
     mPopulation.clear();
+    // two buffers per group, spare one receives crossover children
+    mArena.init(mSettings.popSize * 2, mSettings.maxImages);
     for (int i = 0; i < mSettings.popSize; i++) {
         mPopulation.push_back(PopulationGroup{});
-        mPopulation[i].pastedData = new uint8_t[mReconstructionImage->width*mReconstructionImage->height*4];
+        mPopulation[i].genes = mArena.view(i * 2);
+        mPopulation[i].spare = mArena.view(i * 2 + 1);
+        mPopulation[i].pastedData = new uint8_t[mReconstructionImage->pitch*mReconstructionImage->height];
         mPopulation[i].fitness = UINT64_MAX;
+    }
+}
+
+void Habitat::init_pop() {
+    alloc_pop();
+    for (int i = 0; i < mSettings.popSize; i++) {
+        Rng rng(mSettings.seed, STREAM_INIT | i);
         for (int j = 0; j < mSettings.imgCount; j++) {
-            mPopulation[i].individuals.push_back(random_individual());
+            mPopulation[i].genes.push_back(random_individual(rng));
+        }
+    }
+}
+
+void Habitat::renderAll() {
+    std::vector<int> indexes;
+    for(int i=0; i<mPopulation.size(); i++) {
+        indexes.push_back(i);
+    }
+
+    std::for_each(std::execution::par_unseq, indexes.begin(), indexes.end(), [&](int i) {
+        drawComputeFit(mPopulation[i]);
+    });
+}
+
+void Habitat::enableCheckpoints(const std::string& path, int interval) {
+    mCheckpoint.reset();
+    mCheckpointInterval = interval;
+    if (interval > 0)
+        mCheckpoint.reset(new CheckpointWriter(path));
+}
+
+void Habitat::writeCheckpoint() {
+    if (!mCheckpoint)
+        return;
+    serialize(mCheckpointBuffer);
+    mCheckpoint->submit(mCheckpointBuffer);
+}
+
+void Habitat::flushCheckpoints() {
+    if (mCheckpoint)
+        mCheckpoint->flush();
+}
+
+void Habitat::serialize(std::vector<uint8_t>& out) {
+    out.clear();
+    wire_put_u32(out, CHECKPOINT_MAGIC);
+    wire_put_u32(out, CHECKPOINT_VERSION);
+
+    wire_put_u32(out, mSettings.imgCount);
+    wire_put_u32(out, mSettings.popSize);
+    wire_put_f32(out, mSettings.reroll);
+    wire_put_u32(out, mSettings.crossoverChance);
+    wire_put_f32(out, mSettings.minScale);
+    wire_put_f32(out, mSettings.maxScale);
+    wire_put_u32(out, mSettings.renderMode);
+    wire_put_u32(out, mSettings.edgeWeight);
+    wire_put_u32(out, mSettings.seed);
+    wire_put_u32(out, mSettings.maxImages);
+    wire_put_f32(out, mSettings.colorGuide);
+
+    wire_put_u64(out, mGeneration);
+    wire_put_u32(out, mLevel);
+    wire_put_u32(out, mRefImages->size());
+    wire_put_u32(out, mPopulation.size());
+    std::vector<Individual> genes;
+    for (int i = 0; i < mPopulation.size(); i++) {
+        const Genome& g = mPopulation[i].genes;
+        genes.resize(g.count);
+        for (int j = 0; j < g.count; j++) {
+            genes[j] = g.get(j);
         }
+        wire_put_u64(out, mPopulation[i].fitness);
+        wire_put_genes(out, genes);
     }
+
+    wire_put_u64(out, wire_checksum(out.data(), out.size()));
+}
+
+bool Habitat::loadCheckpoint(const std::string& path) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cout << "could not open checkpoint " << path << std::endl;
+        return false;
+    }
+    const uint8_t* data = file.data();
+    size_t size = file.size();
+
+    size_t pos = size - 8;
+    uint64_t checksum;
+    if (size < 16 || !wire_get_u64(data, size, &pos, &checksum) || checksum != wire_checksum(data, size - 8)) {
+        std::cout << "checkpoint " << path << " is corrupt" << std::endl;
+        return false;
+    }
+    size -= 8;
+
+    pos = 0;
+    uint32_t magic, version;
+    wire_get_u32(data, size, &pos, &magic);
+    wire_get_u32(data, size, &pos, &version);
+    if (magic != CHECKPOINT_MAGIC || version < 1 || version > CHECKPOINT_VERSION) {
+        std::cout << "checkpoint " << path << " has unsupported version " << version << std::endl;
+        return false;
+    }
+
+    Settings st;
+    uint32_t v[7];
+    bool ok = wire_get_u32(data, size, &pos, &v[0]) && wire_get_u32(data, size, &pos, &v[1])
+            && wire_get_f32(data, size, &pos, &st.reroll) && wire_get_u32(data, size, &pos, &v[2])
+            && wire_get_f32(data, size, &pos, &st.minScale) && wire_get_f32(data, size, &pos, &st.maxScale)
+            && wire_get_u32(data, size, &pos, &v[3]) && wire_get_u32(data, size, &pos, &v[4])
+            && wire_get_u32(data, size, &pos, &v[5]) && wire_get_u32(data, size, &pos, &v[6]);
+    st.imgCount = v[0];
+    st.popSize = v[1];
+    st.crossoverChance = v[2];
+    st.renderMode = (RenderMode)v[3];
+    st.edgeWeight = v[4];
+    st.seed = v[5];
+    st.maxImages = v[6];
+    st.colorGuide = 0;
+    if (version >= 3)
+        ok = ok && wire_get_f32(data, size, &pos, &st.colorGuide);
+
+    uint64_t generation;
+    uint32_t level = 0, refCount, groups;
+    ok = ok && wire_get_u64(data, size, &pos, &generation);
+    if (version >= 2)
+        ok = ok && wire_get_u32(data, size, &pos, &level);
+    ok = ok && wire_get_u32(data, size, &pos, &refCount) && wire_get_u32(data, size, &pos, &groups);
+    if (!ok || groups != st.popSize) {
+        std::cout << "checkpoint " << path << " is corrupt" << std::endl;
+        return false;
+    }
+    if (refCount != mRefImages->size()) {
+        std::cout << "checkpoint " << path << " was made with " << refCount << " images, have "
+                  << mRefImages->size() << std::endl;
+        return false;
+    }
+    // level 0 needs no schedule, later ones must have been set with setResolutionSchedule
+    if (level > 0 && level >= mLevels.size()) {
+        std::cout << "checkpoint " << path << " was saved at level " << level << ", the resolution schedule has "
+                  << std::max((int)mLevels.size(), 1) << " levels" << std::endl;
+        return false;
+    }
+
+    std::vector<std::vector<Individual>> genes(groups);
+    for (int i = 0; i < groups && ok; i++) {
+        uint64_t fitness;
+        ok = wire_get_u64(data, size, &pos, &fitness) && wire_get_genes(data, size, &pos, genes[i]);
+    }
+    if (!ok) {
+        std::cout << "checkpoint " << path << " is corrupt" << std::endl;
+        return false;
+    }
+
+    mSettings = st;
+    mGeneration = generation;
+    if (level > 0) {
+        mLevel = level;
+        mReconstructionImage = mLevels[mLevel].reconstructionImage;
+        mRefImages = mLevels[mLevel].refImages;
+        prepare_target();
+    }
+    mPlateauFitness = UINT64_MAX;
+    mPlateauTimer.start();
+    alloc_pop();
+    for (int i = 0; i < groups; i++) {
+        for (int j = 0; j < genes[i].size(); j++) {
+            if (genes[i][j].imgID >= 0 && genes[i][j].imgID < refCount)
+                mPopulation[i].genes.push_back(genes[i][j]);
+        }
+    }
+    // canvases are not stored, fitness is recomputed against the current target
+    renderAll();
+    return true;
 }
 
 void Habitat::drawComputeFit(PopulationGroup& grp) {
-    memset(grp.pastedData, 0x00, mReconstructionImage->width*mReconstructionImage->height*4);
+    Rect full = Rect{0, 0, mReconstructionImage->width - 1, mReconstructionImage->height - 1};
+    composite(grp, full);
+    grp.fitness = regionFitness(grp, full);
+}
+
+// Recomposites only the dirty region from the whole layer stack and
+// updates fitness by the difference of that region.
+void Habitat::drawComputeFit(PopulationGroup& grp, Rect dirty) {
+    int w = mReconstructionImage->width;
+    int h = mReconstructionImage->height;
+
+    // Canvas was never rendered, nothing to update incrementally
+    if (grp.fitness == UINT64_MAX) {
+        drawComputeFit(grp);
+        return;
+    }
+
+    dirty.minx = std::max(dirty.minx, 0);
+    dirty.miny = std::max(dirty.miny, 0);
+    dirty.maxx = std::min(dirty.maxx, w - 1);
+    dirty.maxy = std::min(dirty.maxy, h - 1);
+    if (rect_empty(dirty))
+        return;
+
+    uint64_t oldFit = regionFitness(grp, dirty);
+    composite(grp, dirty);
+    grp.fitness = grp.fitness - oldFit + regionFitness(grp, dirty);
+}
+
+// Painter canvases already hold every layer under a newly added top one, so drawing
+// just that layer over its box gives the same canvas as recompositing the box:
+// cost follows the sprite's area, not the number of layers under it.
+void Habitat::drawTopComputeFit(PopulationGroup& grp, Rect dirty) {
+    if (grp.fitness == UINT64_MAX || mSettings.renderMode != RENDER_PAINTER || grp.genes.count == 0) {
+        drawComputeFit(grp, dirty);
+        return;
+    }
+
+    dirty.minx = std::max(dirty.minx, 0);
+    dirty.miny = std::max(dirty.miny, 0);
+    dirty.maxx = std::min(dirty.maxx, mReconstructionImage->width - 1);
+    dirty.maxy = std::min(dirty.maxy, mReconstructionImage->height - 1);
+    if (rect_empty(dirty))
+        return;
+
+    uint64_t oldFit = regionFitness(grp, dirty);
+    drawLayer(grp, grp.genes.get(grp.genes.count - 1), dirty);
+    grp.fitness = grp.fitness - oldFit + regionFitness(grp, dirty);
+}
+
+// Clears region r of the canvas and draws every layer intersecting it
+void Habitat::composite(PopulationGroup& grp, const Rect& r) {
+    {
+        PROFILE_SCOPE(PROF_CLEAR);
+        int rowBytes = (r.maxx - r.minx + 1) * 4;
+        for (int y = r.miny; y <= r.maxy; y++) {
+            memset(grp.pastedData + y * mReconstructionImage->pitch + r.minx * 4, 0x00, rowBytes);
+        }
+    }
+
+    if (mSettings.renderMode == RENDER_FRONT_TO_BACK) {
+        compositeFrontToBack(grp, r);
+        return;
+    }
+
+    for (int i = 0; i < grp.genes.count; i++) {
+        drawLayer(grp, grp.genes.get(i), r);
+    }
+}
+
+// Painter draw of one layer clipped to region r of the canvas
+void Habitat::drawLayer(PopulationGroup& grp, const Individual& indiv, const Rect& r) {
+    int w = mReconstructionImage->width;
+    int h = mReconstructionImage->height;
+    Rect b = individualBounds(indiv);
+    if (b.maxx < r.minx || b.minx > r.maxx || b.maxy < r.miny || b.miny > r.maxy)
+        return;
+    PROFILE_SCOPE(PROF_RENDER);
+    PROFILE_COUNT(PROF_PIXELS_RENDERED, (uint64_t)(std::min(b.maxx, r.maxx) - std::max(b.minx, r.minx) + 1) *
+                                        (std::min(b.maxy, r.maxy) - std::max(b.miny, r.miny) + 1));
+
+    RotatePixel_t *pDstBase = static_cast<RotatePixel_t*>((void*)grp.pastedData);
+    std::shared_ptr<const StreamedImage> hold;
+    const SrcImage* pImg = refImage(indiv.imgID, hold);
+    if (useSpriteCache()) {
+        mSpriteCache->draw(pDstBase, w, h, mReconstructionImage->pitch,
+                           indiv.imgID, *pImg,
+                           indiv.xp * w, indiv.yp * h,
+                           indiv.angle, (indiv.scale*w)/(pImg->width),
+                           r.minx, r.miny, r.maxx, r.maxy);
+        return;
+    }
+
+    RotatePixel_t *pSrcBase = static_cast<RotatePixel_t*>((void*)pImg->data);
+    RotateDrawClipRegion(pDstBase, w, h, mReconstructionImage->pitch,
+                         pSrcBase, pImg->width, pImg->height, pImg->pitch,
+                         indiv.xp * w, indiv.yp * h,
+                         0, 0,
+                         indiv.angle, (indiv.scale*w)/(pImg->width),
+                         r.minx, r.miny, r.maxx, r.maxy);
+}
+
+// Walks layers from the top, each pixel is sampled only by the topmost layer
+// covering it. Stops once the whole region is covered.
+void Habitat::compositeFrontToBack(PopulationGroup& grp, const Rect& r) {
+    static thread_local std::vector<uint64_t> coverage;
+
+    int w = mReconstructionImage->width;
+    int h = mReconstructionImage->height;
+    int words = (w + 63) >> 6;
+
+    if (coverage.size() < (size_t)words * h)
+        coverage.resize((size_t)words * h);
+    for (int y = r.miny; y <= r.maxy; y++) {
+        memset(&coverage[(size_t)y * words], 0, words * sizeof(uint64_t));
+    }
+
+    int64_t area = (int64_t)(r.maxx - r.minx + 1) * (r.maxy - r.miny + 1);
+    int64_t covered = 0;
 
     RotatePixel_t *pDstBase = static_cast<RotatePixel_t*>((void*)grp.pastedData);
 
-    for (int i = 0; i < grp.individuals.size(); i++) {
-        const SrcImage* pImg = grp.individuals[i].img;
+    for (int i = grp.genes.count - 1; i >= 0 && covered < area; i--) {
+        Individual indiv = grp.genes.get(i);
+        Rect b = individualBounds(indiv);
+        if (b.maxx < r.minx || b.minx > r.maxx || b.maxy < r.miny || b.miny > r.maxy)
+            continue;
+        PROFILE_SCOPE(PROF_RENDER);
+        PROFILE_COUNT(PROF_PIXELS_RENDERED, (uint64_t)(std::min(b.maxx, r.maxx) - std::max(b.minx, r.minx) + 1) *
+                                            (std::min(b.maxy, r.maxy) - std::max(b.miny, r.miny) + 1));
+
+        std::shared_ptr<const StreamedImage> hold;
+        const SrcImage* pImg = refImage(indiv.imgID, hold);
         RotatePixel_t *pSrcBase = static_cast<RotatePixel_t*>((void*)pImg->data);
-        RotateDrawClip(pDstBase, mReconstructionImage->width, mReconstructionImage->height, mReconstructionImage->pitch,
-                       pSrcBase, pImg->width, pImg->height, pImg->pitch,
-                       grp.individuals[i].xp * mReconstructionImage->width,
-                       grp.individuals[i].yp * mReconstructionImage->height,
-                       0, 0,
-                       grp.individuals[i].angle, (grp.individuals[i].scale*mReconstructionImage->width)/(pImg->width));
-    }
-
-    grp.fitness = compute_sad(grp.pastedData, mReconstructionImage->data,
-                               mReconstructionImage->width*mReconstructionImage->height*4);
-    //uint8_t* recGrey = to_greyscale(mReconstructionImage->data, mReconstructionImage->width,
-    //                        mReconstructionImage->height, mReconstructionImage->pitch);
-    //uint8_t* edges = SobelSimd(recGrey, mReconstructionImage->width,
-    //                    mReconstructionImage->height, mReconstructionImage->width);
-    //grp.fitness += compute_sad(edges, mRecSobel,
-    //                           mReconstructionImage->width*mReconstructionImage->height);
-    //delete[] recGrey;
-    //delete[] edges;
-}
-
-void Habitat::crossover(const PopulationGroup& grpA, const PopulationGroup& grpB, PopulationGroup& grpC) {
-    grpC.individuals.clear();
-    for (int i = 0; i < std::min(grpA.individuals.size(),
-                                grpB.individuals.size()); i++) {
-        if (rand()%2) {
-            grpC.individuals.push_back(grpA.individuals[i]);
-        } else {
-            grpC.individuals.push_back(grpB.individuals[i]);
+        covered += RotateDrawClipRegionCovered(pDstBase, w, h, mReconstructionImage->pitch,
+                                               pSrcBase, pImg->width, pImg->height, pImg->pitch,
+                                               indiv.xp * w, indiv.yp * h,
+                                               0, 0,
+                                               indiv.angle, (indiv.scale*w)/(pImg->width),
+                                               r.minx, r.miny, r.maxx, r.maxy,
+                                               coverage.data(), words);
+    }
+}
+
+// Pixels of a library image, hold keeps streamed pixels alive while they are drawn
+const SrcImage* Habitat::refImage(int imgID, std::shared_ptr<const StreamedImage>& hold) {
+    if (mStream == NULL)
+        return &(*mRefImages)[imgID];
+    hold = mStream->acquire(imgID);
+    return &hold->img;
+}
+
+// Images of groups that survive the step are the likeliest to be drawn next
+void Habitat::prefetchElites() {
+    int elites = mSettings.popSize - ceil(mSettings.popSize * mSettings.reroll);
+    std::vector<int> ids;
+    for (int i = 0; i < elites && i < mPopulation.size(); i++) {
+        const Genome& g = mPopulation[i].genes;
+        ids.insert(ids.end(), g.imgID, g.imgID + g.count);
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    mStream->prefetch(ids);
+}
+
+// Part of fitness that depends on pixels of r
+uint64_t Habitat::regionFitness(const PopulationGroup& grp, const Rect& r) {
+    uint64_t fit = regionSad(grp, r);
+    if (mSettings.edgeWeight > 0) {
+        // edge of a pixel depends on its neighbours
+        Rect e = Rect{r.minx - 1, r.miny - 1, r.maxx + 1, r.maxy + 1};
+        fit += (uint64_t)mSettings.edgeWeight * regionEdgeSad(grp, e);
+    }
+    return fit;
+}
+
+uint64_t Habitat::regionSad(const PopulationGroup& grp, const Rect& r) {
+    PROFILE_SCOPE(PROF_SAD);
+    int pitch = mReconstructionImage->pitch;
+    if (r.minx == 0 && r.maxx == mReconstructionImage->width - 1 && pitch == mReconstructionImage->width * 4) {
+        size_t offset = (size_t)r.miny * pitch;
+        return compute_sad(grp.pastedData + offset, mReconstructionImage->data + offset,
+                           (size_t)(r.maxy - r.miny + 1) * pitch);
+    }
+
+    uint64_t sum = 0;
+    int rowBytes = (r.maxx - r.minx + 1) * 4;
+    for (int y = r.miny; y <= r.maxy; y++) {
+        size_t offset = (size_t)y * pitch + r.minx * 4;
+        sum += compute_sad(grp.pastedData + offset, mReconstructionImage->data + offset, rowBytes);
+    }
+    return sum;
+}
+
+// Edge SAD against mRecSobel over interior pixels of r
+uint64_t Habitat::regionEdgeSad(const PopulationGroup& grp, const Rect& r) {
+    static thread_local std::vector<uint8_t> edges;
+    PROFILE_SCOPE(PROF_EDGES);
+
+    int w = mReconstructionImage->width;
+    int h = mReconstructionImage->height;
+    Rect e = Rect{std::max(r.minx, 1), std::max(r.miny, 1), std::min(r.maxx, w - 2), std::min(r.maxy, h - 2)};
+    if (rect_empty(e))
+        return 0;
+
+    if (edges.size() < (size_t)w * h)
+        edges.resize((size_t)w * h);
+
+    sobel_fused_region(grp.pastedData, w, h, mReconstructionImage->pitch,
+                       e.minx, e.miny, e.maxx, e.maxy, edges.data(), w);
+
+    uint64_t sum = 0;
+    for (int y = e.miny; y <= e.maxy; y++) {
+        size_t offset = (size_t)y * w + e.minx;
+        sum += compute_sad(edges.data() + offset, mRecSobel + offset, e.maxx - e.minx + 1);
+    }
+    return sum;
+}
+
+// Same box RotateDrawClip (or the sprite cache) touches for this individual in drawComputeFit
+Rect Habitat::individualBounds(const Individual& indiv) {
+    const SrcImage* pImg = &(*mRefImages)[indiv.imgID];
+    Rect r;
+    if (useSpriteCache()) {
+        if (!mSpriteCache->bounds(mReconstructionImage->width, mReconstructionImage->height, *pImg,
+                                  indiv.xp * mReconstructionImage->width,
+                                  indiv.yp * mReconstructionImage->height,
+                                  indiv.angle, (indiv.scale*mReconstructionImage->width)/(pImg->width),
+                                  &r.minx, &r.miny, &r.maxx, &r.maxy)) {
+            return EMPTY_RECT;
         }
+        return r;
+    }
+    if (!RotateGetClipBounds(mReconstructionImage->width, mReconstructionImage->height,
+                             pImg->width, pImg->height,
+                             indiv.xp * mReconstructionImage->width,
+                             indiv.yp * mReconstructionImage->height,
+                             0, 0,
+                             indiv.angle, (indiv.scale*mReconstructionImage->width)/(pImg->width),
+                             &r.minx, &r.miny, &r.maxx, &r.maxy)) {
+        return EMPTY_RECT;
+    }
+    return r;
+}
+
+// Child is built in grpC's spare buffer, returns union of boxes of layers that differ from old grpC
+Rect Habitat::crossover(const PopulationGroup& grpA, const PopulationGroup& grpB, PopulationGroup& grpC, Rng& rng) {
+    Genome& child = grpC.spare;
+    child.count = std::min(std::min(grpA.genes.count, grpB.genes.count), child.capacity);
+    for (int i = 0; i < child.count; i++) {
+        const Genome& parent = (rng.next()%2) ? grpA.genes : grpB.genes;
+        child.imgID[i] = parent.imgID[i];
+        child.xp[i] = parent.xp[i];
+        child.yp[i] = parent.yp[i];
+        child.angle[i] = parent.angle[i];
+        child.scale[i] = parent.scale[i];
+    }
+
+    const Genome& old = grpC.genes;
+    Rect dirty = EMPTY_RECT;
+    for (int i = 0; i < std::max(child.count, old.count); i++) {
+        bool inOld = i < old.count;
+        bool inNew = i < child.count;
+        if (inOld && inNew && old.same(i, child, i))
+            continue;
+        if (inOld)
+            dirty = rect_union(dirty, individualBounds(old.get(i)));
+        if (inNew)
+            dirty = rect_union(dirty, individualBounds(child.get(i)));
     }
+
+    std::swap(grpC.genes, grpC.spare);
+    return dirty;
 }
 
-void Habitat::mutate(PopulationGroup& grp) {
-    int roll = rand()%100;
+Rect Habitat::mutate(PopulationGroup& grp, Rng& rng, bool* pAdded) {
+    int roll = rng.next()%100;
     if (roll < 60) {
-        mutateAdjust(grp);
+        return mutateAdjust(grp, rng);
     } else if (roll < 90) {
-        mutateAdd(grp);
+        Rect dirty = mutateAdd(grp, rng);
+        *pAdded = !rect_empty(dirty);
+        return dirty;
     } else {
-        mutateRemove(grp);
+        return mutateRemove(grp, rng);
     }
 }
 
-void Habitat::mutateAdd(PopulationGroup& grp) {
-    grp.individuals.push_back(random_individual());
+Rect Habitat::mutateAdd(PopulationGroup& grp, Rng& rng) {
+    Individual indiv = random_individual(rng);
+    if (mPlacementCandidates > 1 && grp.fitness != UINT64_MAX && grp.genes.count < grp.genes.capacity)
+        indiv = searchPlacement(grp, indiv, rng);
+    if (!grp.genes.push_back(indiv))
+        return EMPTY_RECT;
+    return individualBounds(indiv);
 }
 
-void Habitat::mutateRemove(PopulationGroup& grp) {
-    if (grp.individuals.size() == 0)
-        return;
+Rect Habitat::mutateRemove(PopulationGroup& grp, Rng& rng) {
+    if (grp.genes.count == 0)
+        return EMPTY_RECT;
 
-    int ind = rand()%grp.individuals.size();
-    grp.individuals.erase(grp.individuals.begin() + ind);
+    int ind = rng.next()%grp.genes.count;
+    Rect dirty = individualBounds(grp.genes.get(ind));
+    grp.genes.erase(ind);
+    return dirty;
 }
 
-void Habitat::mutateAdjust(PopulationGroup& grp) {
-    //for (int i = 0; i < grp.individuals.size(); i++) {
+Rect Habitat::mutateAdjust(PopulationGroup& grp, Rng& rng) {
+    if (grp.genes.count == 0)
+        return EMPTY_RECT;
+
+    Rect dirty;
+    //for (int i = 0; i < grp.genes.count; i++) {
     {
-        int i = rand()%grp.individuals.size();
-        // ADD CLOSEST IMAGES
-        if (rand()%10 > 8) {
-            grp.individuals[i].imgID = rand()%(mClosestImages[i].size());
-            grp.individuals[i].img = &(*mRefImages)[grp.individuals[i].imgID];
+        int i = rng.next()%grp.genes.count;
+        Individual indiv = grp.genes.get(i);
+        dirty = individualBounds(indiv);
+        bool guided = false;
+        if (rng.next()%10 > 8) {
+            if (rng.next()%1000 < mSettings.colorGuide * 1000) {
+                guided = true;
+            } else if (!mIndex->closest[indiv.imgID].empty()) {
+                const std::vector<distToImg>& closest = mIndex->closest[indiv.imgID];
+                indiv.imgID = closest[rng.next()%closest.size()].imgId;
+            }
         }
 
-        grp.individuals[i].angle += rand()%50 / 100.0 * std::pow(-1, rand()%2);
-        grp.individuals[i].xp += rand()%(1001)/1000.0 * 0.1 * std::pow(-1, rand()%2);
-        grp.individuals[i].yp += rand()%(1001)/1000.0 * 0.1 * std::pow(-1, rand()%2);
-        float randScale = (rand()%((int)(1000*mSettings.maxScale - 1000*mSettings.minScale))
+        indiv.angle += rng.next()%50 / 100.0 * std::pow(-1, rng.next()%2);
+        indiv.xp += rng.next()%(1001)/1000.0 * 0.1 * std::pow(-1, rng.next()%2);
+        indiv.yp += rng.next()%(1001)/1000.0 * 0.1 * std::pow(-1, rng.next()%2);
+        float randScale = (rng.next()%((int)(1000*mSettings.maxScale - 1000*mSettings.minScale))
                                                 + (1000*mSettings.minScale)) / 1000.0;
-        grp.individuals[i].scale += randScale * 0.1 * std::pow(-1, rand()%2);
-        if (grp.individuals[i].scale < mSettings.minScale) {
-            grp.individuals[i].scale = mSettings.minScale;
-        } else if (grp.individuals[i].scale > mSettings.maxScale) {
-            grp.individuals[i].scale = mSettings.maxScale;
+        indiv.scale += randScale * 0.1 * std::pow(-1, rng.next()%2);
+        if (indiv.scale < mSettings.minScale) {
+            indiv.scale = mSettings.minScale;
+        } else if (indiv.scale > mSettings.maxScale) {
+            indiv.scale = mSettings.maxScale;
         }
+        // swapped image matches the target under the new placement
+        if (guided)
+            indiv.imgID = guidedImage(indiv, rng);
+        grp.genes.set(i, indiv);
+        dirty = rect_union(dirty, individualBounds(indiv));
     }
+    return dirty;
 }
 
-Individual Habitat::random_individual() {
+Individual Habitat::random_individual(Rng& rng) {
     Individual newIndiv;
 
-    SrcImage* img;
-    int imgID;
+    newIndiv.imgID = rng.next()%(mRefImages->size());
+    random_placement(newIndiv, rng);
+    if (mSettings.colorGuide > 0 && rng.next()%1000 < mSettings.colorGuide * 1000)
+        newIndiv.imgID = guidedImage(newIndiv, rng);
+
+    return newIndiv;
 
-    newIndiv.imgID = rand()%(mRefImages->size());
-    newIndiv.img = &(*mRefImages)[newIndiv.imgID];
+}
 
-    newIndiv.xp = rand()%(1001)/1000.0;
-    newIndiv.yp = rand()%(1001)/1000.0;
-    newIndiv.angle = rand()%(314) / 100.0;
-    float scale = (rand()%((int)(1000*mSettings.maxScale - 1000*mSettings.minScale))
+void Habitat::random_placement(Individual& indiv, Rng& rng) {
+    indiv.xp = rng.next()%(1001)/1000.0;
+    indiv.yp = rng.next()%(1001)/1000.0;
+    indiv.angle = rng.next()%(314) / 100.0;
+    float scale = (rng.next()%((int)(1000*mSettings.maxScale - 1000*mSettings.minScale))
                                                 + (1000*mSettings.minScale)) / 1000.0;
 
-    newIndiv.scale = scale;
+    indiv.scale = scale;
+}
 
-    return newIndiv;
+// indiv's image at its own and mPlacementCandidates - 1 random placements, scored against
+// the group's canvas. Already inside the parallel step, so candidates run on this thread.
+Individual Habitat::searchPlacement(const PopulationGroup& grp, const Individual& indiv, Rng& rng) {
+    static thread_local std::vector<Individual> tried;
+    static thread_local std::vector<Placement> candidates;
+
+    int w = mReconstructionImage->width;
+    int h = mReconstructionImage->height;
+    std::shared_ptr<const StreamedImage> hold;
+    const SrcImage* pImg = refImage(indiv.imgID, hold);
+    tried.resize(mPlacementCandidates);
+    candidates.resize(mPlacementCandidates);
+    for (int j = 0; j < mPlacementCandidates; j++) {
+        tried[j] = indiv;
+        if (j > 0)
+            random_placement(tried[j], rng);
+        candidates[j] = Placement{tried[j].xp * w, tried[j].yp * h, tried[j].angle,
+                                  (tried[j].scale*w)/(pImg->width)};
+    }
 
+    PlacementSearch search(mReconstructionImage);
+    PlacementScore best = search.best(*pImg, grp.pastedData, candidates, false);
+    return best.index >= 0 ? tried[best.index] : indiv;
 }
 
-void Habitat::reload_indiv_pointers() {
-    for (int i = 0; i < mSettings.popSize; i++) {
-        for (int j = 0; j < mPopulation[i].individuals.size(); j++) {
-            Individual& indiv = mPopulation[i].individuals[j];
-            indiv.img = &(*mRefImages)[indiv.imgID];
+// One of the GUIDE_CANDIDATES images whose mean colour is closest to the mean of the
+// target under indiv's placement, taken as a square of the drawn width
+int Habitat::guidedImage(const Individual& indiv, Rng& rng) {
+    int w = mReconstructionImage->width;
+    int h = mReconstructionImage->height;
+    Rect r;
+    if (!RotateGetClipBounds(w, h, 256, 256, indiv.xp * w, indiv.yp * h, 0, 0,
+                             indiv.angle, indiv.scale * w / 256, &r.minx, &r.miny, &r.maxx, &r.maxy)) {
+        return indiv.imgID;
+    }
+
+    // table rows are w + 1 entries of 3 channels, row and column 0 are zero
+    size_t stride = (w + 1) * 3;
+    const uint32_t* a = &mTargetSat[r.miny * stride + r.minx * 3];
+    const uint32_t* b = &mTargetSat[r.miny * stride + (r.maxx + 1) * 3];
+    const uint32_t* c = &mTargetSat[(r.maxy + 1) * stride + r.minx * 3];
+    const uint32_t* d = &mTargetSat[(r.maxy + 1) * stride + (r.maxx + 1) * 3];
+    float area = 255.0f * (r.maxx - r.minx + 1) * (r.maxy - r.miny + 1);
+    float rgb[3];
+    for (int ch = 0; ch < 3; ch++)
+        rgb[ch] = (uint32_t)(d[ch] - b[ch] - c[ch] + a[ch]) / area;
+
+    int ids[GUIDE_CANDIDATES];
+    int n = mIndex->colors.nearest(rgb, GUIDE_CANDIDATES, ids);
+    if (n == 0)
+        return indiv.imgID;
+    return ids[rng.next()%n];
+}
+
+void Habitat::prepare_target() {
+    if (mSpriteCache)
+        mSpriteCache->clear();
+
+    // reconstruction image may have been reloaded at another resolution
+    delete[] mRecSobel;
+    mRecSobel = new uint8_t[mReconstructionImage->width * mReconstructionImage->height];
+    sobel_fused(mReconstructionImage->data, mReconstructionImage->width, mReconstructionImage->height,
+                mReconstructionImage->pitch, mRecSobel, mReconstructionImage->width);
+
+    // uint32 sums wrap, region sums stay exact below 16M pixels
+    int w = mReconstructionImage->width;
+    int h = mReconstructionImage->height;
+    size_t stride = (w + 1) * 3;
+    mTargetSat.assign(stride * (h + 1), 0);
+    for (int y = 0; y < h; y++) {
+        const uint8_t* px = mReconstructionImage->data + (size_t)y * mReconstructionImage->pitch;
+        uint32_t* above = &mTargetSat[y * stride];
+        uint32_t* row = &mTargetSat[(y + 1) * stride];
+        uint32_t sum[3] = {0, 0, 0};
+        for (int x = 0; x < w; x++, px += 4) {
+            for (int ch = 0; ch < 3; ch++) {
+                sum[ch] += px[ch];
+                row[(x + 1) * 3 + ch] = above[(x + 1) * 3 + ch] + sum[ch];
+            }
         }
+    }
+}
+
+void Habitat::reload_images() {
+    prepare_target();
+    for (int i = 0; i < mSettings.popSize; i++) {
         delete[] mPopulation[i].pastedData;
-        mPopulation[i].pastedData = new uint8_t[mReconstructionImage->width*mReconstructionImage->height*4];
-        drawComputeFit(mPopulation[i]);
+        mPopulation[i].pastedData = new uint8_t[mReconstructionImage->pitch*mReconstructionImage->height];
     }
+    renderAll();
 }
 
-bool greaterDist(distToImg &first, distToImg &second) {
-    return first.distance > second.distance;
+void Habitat::setResolutionSchedule(const std::vector<ResolutionLevel>& levels, ScheduleSettings schedule) {
+    mLevels = levels;
+    mSchedule = schedule;
+    mLevel = 0;
+    mPlateauFitness = UINT64_MAX;
+    mPlateauTimer.start();
 }
 
-void Habitat::calculateClosest() {
-    mClosestImages.resize(mRefImages->size());
-    for (int i = 0; i < mRefImages->size(); i++) {
-        for (int j = i + 1; j < mRefImages->size(); j++) {
-            uint32_t numPx = std::min( (*mRefImages)[i].width * (*mRefImages)[i].height * 4,
-                                              (*mRefImages)[j].width * (*mRefImages)[j].height * 4);
-            uint32_t metric = compute_sad((*mRefImages)[i].data, (*mRefImages)[j].data, numPx)/numPx;
-            mClosestImages[i].push_back(distToImg{j, metric});
-            mClosestImages[j].push_back(distToImg{i, metric});
-        }
-        std::sort(mClosestImages[i].begin(), mClosestImages[i].end(), greaterDist);
-        mClosestImages[i].resize(5);
+bool Habitat::promoteLevel() {
+    if (mLevel + 1 >= mLevels.size())
+        return false;
+    mLevel++;
+    mReconstructionImage = mLevels[mLevel].reconstructionImage;
+    mRefImages = mLevels[mLevel].refImages;
+    reload_images();
+
+    mPlateauFitness = UINT64_MAX;
+    mPlateauTimer.start();
+    return true;
+}
+
+int Habitat::getLevel() {
+    return mLevel;
+}
+
+const SrcImage* Habitat::getReconstructionImage() {
+    return mReconstructionImage;
+}
+
+uint64_t Habitat::bestFitness() {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < mPopulation.size(); i++) {
+        best = std::min(best, mPopulation[i].fitness);
     }
+    return best;
+}
+
+void Habitat::updateSchedule() {
+    if (mLevel + 1 >= mLevels.size())
+        return;
+    uint64_t at = mLevels[mLevel + 1].atGeneration;
+    if (at != 0 && mGeneration >= at) {
+        promoteLevel();
+        return;
+    }
+
+    // clock is read every 64 generations only
+    if (mSchedule.plateauSeconds <= 0 || mGeneration % 64 != 0)
+        return;
+    // 64-bit microseconds, plateaus can be longer than an int holds
+    int64_t elapsedUs = mPlateauTimer.get();
+    if (elapsedUs < (int64_t)(mSchedule.plateauSeconds * 1e6))
+        return;
+    uint64_t best = bestFitness();
+    if (mPlateauFitness != UINT64_MAX && best != UINT64_MAX
+            && mPlateauFitness - std::min(best, mPlateauFitness) < mSchedule.plateauImprovement * mPlateauFitness) {
+        promoteLevel();
+        return;
+    }
+    mPlateauFitness = best;
+    mPlateauTimer.start();
+}
+
+void Habitat::calculateClosest(int k) {
+    // streamed libraries describe resident thumbnails
+    const std::vector<SrcImage>& imgs = mStream ? *mStream->thumbnails() : *mRefImages;
+    std::shared_ptr<LibraryIndex> index = std::make_shared<LibraryIndex>();
+    index->similarity.build(imgs);
+    index->colors.build(index->similarity);
+    index->closest.resize(imgs.size());
+    std::vector<int> ids(imgs.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    std::for_each(std::execution::par_unseq, ids.begin(), ids.end(), [&](int i) {
+        index->similarity.nearest(i, k, index->closest[i]);
+    });
+    mIndex = index;
+}
+
+const SimilarityIndex& Habitat::getSimilarityIndex() {
+    return mIndex->similarity;
+}
+
+std::shared_ptr<const LibraryIndex> Habitat::getLibraryIndex() {
+    return mIndex;
+}
+
+// Front-to-back mode needs exact coverage, so it always renders directly
+bool Habitat::useSpriteCache() {
+    return mSpriteCache && mSettings.renderMode == RENDER_PAINTER;
+}
+
+void Habitat::enableSpriteCache(size_t budgetBytes, float angleStep, float scaleStep) {
+    mSpriteCache.reset(new SpriteCache(budgetBytes, angleStep, scaleStep));
+
+    // canvases drawn without cache do not match new placement rules
+    std::for_each(std::execution::par_unseq, mPopulation.begin(), mPopulation.end(), [&](PopulationGroup& grp) {
+        if (grp.fitness != UINT64_MAX)
+            drawComputeFit(grp);
+    });
+}
+
+const SpriteCache* Habitat::getSpriteCache() {
+    return mSpriteCache.get();
+}
+
+void Habitat::enablePlacementSearch(int candidates) {
+    mPlacementCandidates = candidates;
 }
 
 Habitat::~Habitat() {
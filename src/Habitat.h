@@ -2,26 +2,40 @@
 #define HABITAT_H
 
 #include "utils.h"
+#include "Rng.h"
+#include "Genome.h"
+#include "SimilarityIndex.h"
+#include "Timer.h"
 #include "vector"
+#include <memory>
 
-#define SETTINGS_DEFAULT Settings{16, 30, 0.85, 65, 0.01, 1}
+class SpriteCache;
+class CheckpointWriter;
+class ImageStream;
+struct StreamedImage;
 
-struct Individual {
-    const SrcImage* img;
+#define SETTINGS_DEFAULT Settings{16, 30, 0.85, 65, 0.01, 1, RENDER_PAINTER, 0, 1, 128, 0.5}
 
-    int imgID;
-    float xp; //xpercent
-    float yp; //ypercent
-    float angle;
-    float scale;
+// Canvas region, inclusive. Empty when minx > maxx.
+struct Rect {
+    int minx;
+    int miny;
+    int maxx;
+    int maxy;
 };
 
 struct PopulationGroup {
-    std::vector<Individual> individuals;
+    Genome genes;
+    Genome spare; // scratch buffer, swapped with genes by crossover
     uint8_t* pastedData;
     uint64_t fitness;
 };
 
+enum RenderMode {
+    RENDER_PAINTER,       // back-to-front, every layer drawn fully
+    RENDER_FRONT_TO_BACK  // topmost first, covered pixels are skipped
+};
+
 struct Settings {
     int imgCount;
     int popSize;
@@ -29,11 +43,31 @@ struct Settings {
     int crossoverChance;
     float minScale;
     float maxScale;
+    RenderMode renderMode;
+    int edgeWeight; // 0 disables edge SAD term of fitness
+    uint32_t seed;  // same seed gives same run at any thread count
+    int maxImages;  // genome capacity, mutateAdd is a no-op at the cap
+    float colorGuide; // chance a new or swapped image is picked by the target colour under it
+};
+
+// Same target and library at one resolution, image IDs must match across levels
+struct ResolutionLevel {
+    const SrcImage* reconstructionImage;
+    const std::vector<SrcImage>* refImages;
+    uint64_t atGeneration; // promote to this level here, 0 leaves it to plateau detection
+};
+
+// Similarity data of one library. Built once per library and shared read-only,
+// e.g. by the islands of an Archipelago, instead of each habitat indexing it again.
+struct LibraryIndex {
+    SimilarityIndex similarity;
+    ColorIndex colors;
+    std::vector<std::vector<distToImg>> closest; // by image ID, closest first
 };
 
-struct distToImg {
-    int imgId;
-    int distance;
+struct ScheduleSettings {
+    float plateauSeconds;     // window improvement is measured over, 0 disables
+    float plateauImprovement; // promote when best fitness drops by less than this fraction in a window
 };
 
 class Habitat
@@ -41,32 +75,112 @@ class Habitat
     public:
         Habitat(const SrcImage* reconstructionImage, const std::vector<SrcImage>* refImages);
         Habitat(const SrcImage* reconstructionImage, const std::vector<SrcImage>* refImages, Settings settings);
+        // Library pixels come from stream on demand, elites' images are prefetched
+        Habitat(const SrcImage* reconstructionImage, ImageStream* stream, Settings settings);
+        // Uses index (built by another habitat over the same library) instead of building one
+        Habitat(const SrcImage* reconstructionImage, const std::vector<SrcImage>* refImages, Settings settings,
+                std::shared_ptr<const LibraryIndex> index);
         virtual ~Habitat();
 
         void step();
 
-        // Todo: are pointers inside invididual worth this function?
-        void reload_indiv_pointers();
-        void calculateClosest();
+        // Call after reference or reconstruction images were reloaded, re-renders every group
+        void reload_images();
+        // Indexes library descriptors and keeps the k most similar images of each,
+        // adjust mutations swap an image for one of them
+        void calculateClosest(int k = 5);
+        const SimilarityIndex& getSimilarityIndex();
+        std::shared_ptr<const LibraryIndex> getLibraryIndex();
         const PopulationGroup& getBestGroup();
+        uint64_t getGeneration();
+
+        // Genes of the k best groups, best first, with their fitness if pFitness is set
+        std::vector<std::vector<Individual>> topGenomes(int k, std::vector<uint64_t>* pFitness = NULL);
+        // Replaces the worst group with genes (e.g. a migrant) and evaluates it
+        void immigrate(const std::vector<Individual>& genes);
+        // Renders genes into canvas of pitch * height bytes of the target, returns fitness
+        uint64_t renderGenes(const std::vector<Individual>& genes, uint8_t* canvas);
+
+        // Painter mode draws through a cache of pre-rotated sprites (approximate placement)
+        void enableSpriteCache(size_t budgetBytes, float angleStep, float scaleStep);
+        const SpriteCache* getSpriteCache();
+
+        // Adds try this many placements of the new image and keep the one that lowers the
+        // canvas error most, scored on the sprite footprint only. 0 or 1 disables.
+        void enablePlacementSearch(int candidates);
+
+        // Snapshots settings, generation and genomes every interval generations,
+        // written on a background thread. The counter based Rng needs no other state.
+        void enableCheckpoints(const std::string& path, int interval);
+        // Queues a snapshot of the current generation now, e.g. before exiting
+        void writeCheckpoint();
+        void flushCheckpoints();
+        // Replaces settings and population from a checkpoint and re-renders in parallel.
+        // Set the resolution schedule first to resume at the saved level.
+        bool loadCheckpoint(const std::string& path);
+
+        // Level 0 is the images the habitat was built with. step() promotes to the next
+        // level at its generation or when fitness plateaus; populations are kept.
+        void setResolutionSchedule(const std::vector<ResolutionLevel>& levels, ScheduleSettings schedule);
+        bool promoteLevel(); // false at the last level
+        int getLevel();
+        const SrcImage* getReconstructionImage(); // target of the current level
     protected:
 
     private:
+        Habitat(const SrcImage* reconstructionImage, const std::vector<SrcImage>* refImages, Settings settings,
+                ImageStream* stream, std::shared_ptr<const LibraryIndex> index);
+
         std::vector<PopulationGroup> mPopulation;
+        GenomeArena mArena;
         const std::vector<SrcImage>* mRefImages;
         const SrcImage* mReconstructionImage;
-        std::vector<std::vector<distToImg>> mClosestImages;
+        std::shared_ptr<const LibraryIndex> mIndex;
+        std::vector<uint32_t> mTargetSat; // summed-area table of the target, 3 channels
         uint8_t* mRecSobel;
         Settings mSettings;
+        uint64_t mGeneration;
+        std::unique_ptr<SpriteCache> mSpriteCache;
+        int mPlacementCandidates;
+        ImageStream* mStream;
+        std::unique_ptr<CheckpointWriter> mCheckpoint;
+        int mCheckpointInterval;
+        std::vector<uint8_t> mCheckpointBuffer;
+        std::vector<ResolutionLevel> mLevels;
+        ScheduleSettings mSchedule;
+        int mLevel;
+        Timer mPlateauTimer;
+        uint64_t mPlateauFitness;
 
+        void alloc_pop();
         void init_pop();
-        Individual random_individual();
-        void crossover(const PopulationGroup& grpA, const PopulationGroup& grpB, PopulationGroup& grpC);
+        void renderAll();
+        void prepare_target();
+        void updateSchedule();
+        uint64_t bestFitness();
+        void serialize(std::vector<uint8_t>& out);
+        Individual random_individual(Rng& rng);
+        void random_placement(Individual& indiv, Rng& rng);
+        Individual searchPlacement(const PopulationGroup& grp, const Individual& indiv, Rng& rng);
+        int guidedImage(const Individual& indiv, Rng& rng);
+        Rect crossover(const PopulationGroup& grpA, const PopulationGroup& grpB, PopulationGroup& grpC, Rng& rng);
         void drawComputeFit(PopulationGroup& grp);
-        void mutate(PopulationGroup& grp);
-        void mutateAdjust(PopulationGroup& grp);
-        void mutateAdd(PopulationGroup& grp);
-        void mutateRemove(PopulationGroup& grp);
+        void drawComputeFit(PopulationGroup& grp, Rect dirty);
+        void drawTopComputeFit(PopulationGroup& grp, Rect dirty);
+        void composite(PopulationGroup& grp, const Rect& r);
+        void drawLayer(PopulationGroup& grp, const Individual& indiv, const Rect& r);
+        void compositeFrontToBack(PopulationGroup& grp, const Rect& r);
+        uint64_t regionFitness(const PopulationGroup& grp, const Rect& r);
+        uint64_t regionSad(const PopulationGroup& grp, const Rect& r);
+        uint64_t regionEdgeSad(const PopulationGroup& grp, const Rect& r);
+        Rect individualBounds(const Individual& indiv);
+        const SrcImage* refImage(int imgID, std::shared_ptr<const StreamedImage>& hold);
+        void prefetchElites();
+        bool useSpriteCache();
+        Rect mutate(PopulationGroup& grp, Rng& rng, bool* pAdded); // pAdded set for a new top layer
+        Rect mutateAdjust(PopulationGroup& grp, Rng& rng);
+        Rect mutateAdd(PopulationGroup& grp, Rng& rng);
+        Rect mutateRemove(PopulationGroup& grp, Rng& rng);
 };
 
 #endif // HABITAT_H
@@ -0,0 +1,480 @@
+#include "ImageStore.h"
+#include "resample.h"
+#include "GenomeWire.h"
+#include "Timer.h"
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <immintrin.h>
+#include <algorithm>
+#include <atomic>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+int aligned_pitch(int width) {
+    return ((width * 4 + 63) / 64) * 64;
+}
+
+void copy_rows(const SrcImage& src, uint8_t* dst, int dstPitch) {
+    for (int y = 0; y < src.height; y++) {
+        uint8_t* row = dst + (size_t)y * dstPitch;
+        memcpy(row, src.data + (size_t)y * src.pitch, src.width * 4);
+        memset(row + src.width * 4, 0, dstPitch - src.width * 4);
+    }
+}
+
+// Size from the PNG or JPEG header, false for other formats
+static bool header_size(const std::vector<uint8_t>& buf, int* pW, int* pH) {
+    const uint8_t* p = buf.data();
+    size_t n = buf.size();
+    if (n >= 24 && p[0] == 0x89 && p[1] == 'P' && p[2] == 'N' && p[3] == 'G') {
+        *pW = (p[16] << 24) | (p[17] << 16) | (p[18] << 8) | p[19];
+        *pH = (p[20] << 24) | (p[21] << 16) | (p[22] << 8) | p[23];
+        return true;
+    }
+    if (n < 4 || p[0] != 0xFF || p[1] != 0xD8)
+        return false;
+    size_t pos = 2;
+    while (pos + 9 < n) {
+        if (p[pos] != 0xFF) {
+            pos++;
+            continue;
+        }
+        uint8_t marker = p[pos + 1];
+        // SOF0..SOF15 carry the frame size, C4/C8/CC are other tables
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            *pH = (p[pos + 5] << 8) | p[pos + 6];
+            *pW = (p[pos + 7] << 8) | p[pos + 8];
+            return true;
+        }
+        if (marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7) || marker == 0xFF) {
+            pos += marker == 0xFF ? 1 : 2;
+            continue;
+        }
+        pos += 2 + ((p[pos + 2] << 8) | p[pos + 3]);
+    }
+    return false;
+}
+
+// Header sizes are those of the stored pixels, the decoder applies EXIF orientation.
+// Swaps w and h when a reduced decode came out transposed.
+static void oriented_size(const cv::Mat& decoded, int reduce, int* pW, int* pH) {
+    int rw = (*pW + reduce - 1) / reduce;
+    int rh = (*pH + reduce - 1) / reduce;
+    if (abs(decoded.cols - rw) <= 1 && abs(decoded.rows - rh) <= 1)
+        return;
+    if (abs(decoded.cols - rh) <= 1 && abs(decoded.rows - rw) <= 1) {
+        std::swap(*pW, *pH);
+        return;
+    }
+    *pW = decoded.cols * reduce;
+    *pH = decoded.rows * reduce;
+}
+
+bool decode_image(const std::string& path, const std::vector<long long>& pxBudgets, DecodedImage& out,
+                  DecodeTiming* pTiming) {
+    Timer t;
+
+    t.start();
+    std::vector<uint8_t> file;
+    std::ifstream in(path, std::ios::binary);
+    if (in) {
+        in.seekg(0, std::ios::end);
+        file.resize((size_t)in.tellg());
+        in.seekg(0, std::ios::beg);
+        in.read((char*)file.data(), file.size());
+    }
+    int readUs = t.get();
+
+    // Level sizes always follow the original size. The decoder may shrink by 2, 4 or 8
+    // (JPEG scales in the DCT) as long as every level is still a downscale.
+    int w = 0, h = 0;
+    int reduce = 1;
+    if (!file.empty() && header_size(file, &w, &h) && w > 0 && h > 0) {
+        long long largest = *std::max_element(pxBudgets.begin(), pxBudgets.end());
+        int lw, lh;
+        budget_size(w, h, largest, &lw, &lh);
+        while (reduce < 8 && w / (reduce * 2) >= lw && h / (reduce * 2) >= lh) {
+            reduce *= 2;
+        }
+    }
+    static const int REDUCE_FLAGS[9] = {0, cv::IMREAD_COLOR, cv::IMREAD_REDUCED_COLOR_2, 0,
+                                        cv::IMREAD_REDUCED_COLOR_4, 0, 0, 0, cv::IMREAD_REDUCED_COLOR_8};
+
+    t.start();
+    cv::Mat bgr;
+    if (!file.empty())
+        bgr = cv::imdecode(file, REDUCE_FLAGS[reduce]);
+    if (bgr.empty())
+        return false;
+    if (reduce == 1) {
+        w = bgr.cols;
+        h = bgr.rows;
+    } else {
+        oriented_size(bgr, reduce, &w, &h);
+    }
+    cv::Mat px;
+    cv::cvtColor(bgr, px, cv::COLOR_BGR2BGRA);
+    int decodeUs = t.get();
+
+    t.start();
+    // stats over decoded pixels, luma as in edges.h
+    double sum[3] = {0, 0, 0};
+    double lumaSum = 0, lumaSq = 0;
+    for (int y = 0; y < px.rows; y++) {
+        const uint8_t* row = px.data + (size_t)y * px.step;
+        for (int x = 0; x < px.cols; x++) {
+            int luma = (row[x * 4] + row[x * 4 + 1] + row[x * 4 + 2]) / 3;
+            sum[0] += row[x * 4];
+            sum[1] += row[x * 4 + 1];
+            sum[2] += row[x * 4 + 2];
+            lumaSum += luma;
+            lumaSq += luma * luma;
+        }
+    }
+    double n = (double)px.cols * px.rows;
+    for (int c = 0; c < 3; c++) {
+        out.stats.mean[c] = sum[c] / n;
+    }
+    out.stats.lumaStddev = sqrt(std::max(lumaSq / n - (lumaSum / n) * (lumaSum / n), 0.0));
+
+    int levels = pxBudgets.size();
+    out.levels.resize(levels);
+    out.pixels.resize(levels);
+    for (int l = 0; l < levels; l++) {
+        int lw, lh;
+        budget_size(w, h, pxBudgets[l], &lw, &lh);
+        lw = std::min(lw, px.cols);
+        lh = std::min(lh, px.rows);
+        out.pixels[l].resize((size_t)lw * lh * 4);
+        resample_area(px.data, px.cols, px.rows, px.step, out.pixels[l].data(), lw, lh, lw * 4);
+        out.levels[l].width = lw;
+        out.levels[l].height = lh;
+        out.levels[l].pitch = lw * 4;
+        out.levels[l].sad = -1;
+        out.levels[l].path = path;
+        out.levels[l].data = out.pixels[l].data();
+    }
+    int resampleUs = t.get();
+
+    if (pTiming) {
+        pTiming->readUs = readUs;
+        pTiming->decodeUs = decodeUs;
+        pTiming->resampleUs = resampleUs;
+    }
+    return true;
+}
+
+void placeholder_image(const std::string& path, int levels, DecodedImage& out) {
+    memset(&out.stats, 0, sizeof(out.stats));
+    out.levels.resize(levels);
+    out.pixels.assign(levels, std::vector<uint8_t>(4, 0));
+    for (int l = 0; l < levels; l++) {
+        out.levels[l].width = 1;
+        out.levels[l].height = 1;
+        out.levels[l].pitch = 4;
+        out.levels[l].sad = -1;
+        out.levels[l].path = path;
+        out.levels[l].data = out.pixels[l].data();
+    }
+}
+
+void decode_images(const std::vector<std::string>& paths, const std::vector<long long>& pxBudgets,
+                   const std::function<void(int, DecodedImage&)>& sink, LoadTiming* pTiming) {
+    std::atomic<int> next(0);
+    std::mutex failedMutex;
+    std::vector<int> failed;
+    std::atomic<uint64_t> readUs(0), decodeUs(0), resampleUs(0);
+
+    Timer wall;
+    wall.start();
+    // one image in flight per worker bounds memory to a few full resolution decodes
+    int workers = std::max(1, std::min((int)std::thread::hardware_concurrency(), (int)paths.size()));
+    std::vector<std::thread> threads;
+    for (int w = 0; w < workers; w++) {
+        threads.emplace_back([&] {
+            for (int i = next++; i < paths.size(); i = next++) {
+                DecodedImage decoded;
+                DecodeTiming t;
+                if (!decode_image(paths[i], pxBudgets, decoded, &t)) {
+                    std::lock_guard<std::mutex> lock(failedMutex);
+                    failed.push_back(i);
+                    continue;
+                }
+                readUs += t.readUs;
+                decodeUs += t.decodeUs;
+                resampleUs += t.resampleUs;
+                sink(i, decoded);
+            }
+        });
+    }
+    for (int w = 0; w < workers; w++) {
+        threads[w].join();
+    }
+
+    std::sort(failed.begin(), failed.end());
+    for (int i = 0; i < failed.size(); i++) {
+        std::cout << "could not decode " << paths[failed[i]] << ", it keeps its ID as a blank image" << std::endl;
+    }
+    if (pTiming) {
+        pTiming->images = paths.size() - failed.size();
+        pTiming->failed = failed.size();
+        pTiming->readMs = readUs / 1000.0;
+        pTiming->decodeMs = decodeUs / 1000.0;
+        pTiming->resampleMs = resampleUs / 1000.0;
+        pTiming->wallMs = wall.get() / 1000.0;
+    }
+}
+
+std::vector<std::string> list_images(const std::string& dir) {
+    std::vector<std::string> paths;
+    for (const auto & entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.is_regular_file())
+            paths.push_back(entry.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+ImageStore::ImageStore() : mSlab(NULL), mPixels(NULL), mSlabBytes(0), mTiming{} {
+
+}
+
+ImageStore::~ImageStore() {
+    clear();
+}
+
+void ImageStore::clear() {
+    if (mSlab)
+        _mm_free(mSlab);
+    mSlab = NULL;
+    mPixels = NULL;
+    mSlabBytes = 0;
+    mPack.reset();
+    mPaths.clear();
+    mLevels.clear();
+    mBudgets.clear();
+    mStats.clear();
+}
+
+void ImageStore::exclude(int id) {
+    mPaths.erase(mPaths.begin() + id);
+    mStats.erase(mStats.begin() + id);
+    for (int l = 0; l < mLevels.size(); l++) {
+        mLevels[l].erase(mLevels[l].begin() + id);
+    }
+}
+
+bool ImageStore::load(const std::vector<std::string>& paths, const std::vector<long long>& pxBudgets) {
+    clear();
+    int levels = pxBudgets.size();
+
+    // Pass 1: decode once, resample to every level into temporary tight buffers
+    std::vector<DecodedImage> decoded(paths.size());
+    std::vector<char> ok(paths.size(), 0);
+    decode_images(paths, pxBudgets, [&](int i, DecodedImage& d) {
+        decoded[i] = std::move(d);
+        ok[i] = 1;
+    }, &mTiming);
+    if (std::find(ok.begin(), ok.end(), 1) == ok.end())
+        return false;
+    for (int i = 0; i < decoded.size(); i++) {
+        if (!ok[i])
+            placeholder_image(paths[i], levels, decoded[i]);
+    }
+
+    // Pass 2: one slab for everything, level-major so each level is contiguous
+    mLevels.resize(levels);
+    std::vector<size_t> offsets;
+    size_t total = 0;
+    for (int l = 0; l < levels; l++) {
+        for (int i = 0; i < decoded.size(); i++) {
+            SrcImage img = decoded[i].levels[l];
+            img.pitch = aligned_pitch(img.width);
+            img.data = NULL;
+            offsets.push_back(total);
+            total += (size_t)img.pitch * img.height;
+            mLevels[l].push_back(img);
+        }
+    }
+    for (int i = 0; i < decoded.size(); i++) {
+        mPaths.push_back(paths[i]);
+        mStats.push_back(decoded[i].stats);
+    }
+    mBudgets = pxBudgets;
+
+    mSlab = (uint8_t*)_mm_malloc(total, 64);
+    if (mSlab == NULL) {
+        std::cout << "could not allocate " << total << " bytes for images" << std::endl;
+        clear();
+        return false;
+    }
+    mSlabBytes = total;
+    mPixels = mSlab;
+
+    int count = mPaths.size();
+    std::vector<int> slots(count * levels);
+    for (int i = 0; i < slots.size(); i++) {
+        slots[i] = i;
+    }
+    std::for_each(std::execution::par_unseq, slots.begin(), slots.end(), [&](int s) {
+        int l = s / count;
+        int id = s % count;
+        SrcImage& img = mLevels[l][id];
+        img.data = mSlab + offsets[s];
+        copy_rows(decoded[id].levels[l], img.data, img.pitch);
+    });
+    return true;
+}
+
+// Layout: magic, version, image count, level count, budgets, per (level, image)
+// width/height/pitch/slab offset, per image stats and path, pixel offset and size,
+// header checksum, then the slab at the pixel offset.
+bool ImageStore::savePack(const std::string& path) const {
+    std::vector<uint8_t> header;
+    wire_put_u32(header, PACK_MAGIC);
+    wire_put_u32(header, PACK_VERSION);
+    wire_put_u32(header, mPaths.size());
+    wire_put_u32(header, mLevels.size());
+    for (int l = 0; l < mLevels.size(); l++) {
+        wire_put_u64(header, mBudgets[l]);
+    }
+    for (int l = 0; l < mLevels.size(); l++) {
+        for (int i = 0; i < mLevels[l].size(); i++) {
+            const SrcImage& img = mLevels[l][i];
+            wire_put_u32(header, img.width);
+            wire_put_u32(header, img.height);
+            wire_put_u32(header, img.pitch);
+            wire_put_u64(header, img.data - mPixels);
+        }
+    }
+    for (int i = 0; i < mPaths.size(); i++) {
+        for (int c = 0; c < 3; c++) {
+            wire_put_f32(header, mStats[i].mean[c]);
+        }
+        wire_put_f32(header, mStats[i].lumaStddev);
+        wire_put_u32(header, mPaths[i].size());
+        header.insert(header.end(), mPaths[i].begin(), mPaths[i].end());
+    }
+    // pixels start on a page boundary so the mapping keeps slab alignment
+    uint64_t pixelOffset = ((header.size() + 24 + 4095) / 4096) * 4096;
+    wire_put_u64(header, pixelOffset);
+    wire_put_u64(header, mSlabBytes);
+    wire_put_u64(header, wire_checksum(header.data(), header.size()));
+    header.resize(pixelOffset, 0);
+
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (f == NULL) {
+        std::cout << "could not write pack " << tmp << std::endl;
+        return false;
+    }
+    bool ok = fwrite(header.data(), 1, header.size(), f) == header.size();
+    ok = ok && fwrite(mPixels, 1, mSlabBytes, f) == mSlabBytes;
+    ok = fclose(f) == 0 && ok;
+    std::error_code ec;
+    if (ok)
+        std::filesystem::rename(tmp, path, ec);
+    if (!ok || ec) {
+        std::cout << "could not write pack " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ImageStore::loadPack(const std::string& path) {
+    clear();
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(path))
+        return false;
+    const uint8_t* data = file->data();
+    size_t size = file->size();
+
+    size_t pos = 0;
+    uint32_t magic, version, count, levels;
+    bool ok = wire_get_u32(data, size, &pos, &magic) && wire_get_u32(data, size, &pos, &version)
+            && wire_get_u32(data, size, &pos, &count) && wire_get_u32(data, size, &pos, &levels);
+    if (!ok || magic != PACK_MAGIC || version != PACK_VERSION) {
+        std::cout << "pack " << path << " has unsupported format" << std::endl;
+        return false;
+    }
+    // nothing is sized from the header before it is known to fit the file: a budget per
+    // level, 20 bytes per image and level, at least 20 per image stats and path, 24 trailer
+    uint64_t minBytes = (uint64_t)levels * 8 + (uint64_t)levels * count * 20 + (uint64_t)count * 20 + 24;
+    if (levels > size || count > size || minBytes > size - pos) {
+        std::cout << "pack " << path << " is corrupt" << std::endl;
+        return false;
+    }
+
+    mBudgets.resize(levels);
+    for (int l = 0; l < levels && ok; l++) {
+        uint64_t budget;
+        ok = wire_get_u64(data, size, &pos, &budget);
+        mBudgets[l] = budget;
+    }
+    mLevels.resize(levels);
+    std::vector<uint64_t> offsets;
+    for (int l = 0; l < levels && ok; l++) {
+        mLevels[l].resize(count);
+        for (int i = 0; i < count && ok; i++) {
+            uint32_t w, h, pitch;
+            uint64_t offset;
+            ok = wire_get_u32(data, size, &pos, &w) && wire_get_u32(data, size, &pos, &h)
+                    && wire_get_u32(data, size, &pos, &pitch) && wire_get_u64(data, size, &pos, &offset);
+            SrcImage& img = mLevels[l][i];
+            img.width = w;
+            img.height = h;
+            img.pitch = pitch;
+            img.sad = -1;
+            img.data = NULL;
+            offsets.push_back(offset);
+        }
+    }
+    mStats.resize(count);
+    mPaths.resize(count);
+    for (int i = 0; i < count && ok; i++) {
+        uint32_t len;
+        ok = wire_get_f32(data, size, &pos, &mStats[i].mean[0]) && wire_get_f32(data, size, &pos, &mStats[i].mean[1])
+                && wire_get_f32(data, size, &pos, &mStats[i].mean[2]) && wire_get_f32(data, size, &pos, &mStats[i].lumaStddev)
+                && wire_get_u32(data, size, &pos, &len) && len <= size - pos;
+        if (ok) {
+            mPaths[i].assign((const char*)data + pos, len);
+            pos += len;
+        }
+    }
+    uint64_t pixelOffset, pixelBytes, checksum;
+    ok = ok && wire_get_u64(data, size, &pos, &pixelOffset) && wire_get_u64(data, size, &pos, &pixelBytes);
+    size_t headerEnd = pos;
+    ok = ok && wire_get_u64(data, size, &pos, &checksum) && checksum == wire_checksum(data, headerEnd)
+            && pixelOffset <= size && pixelBytes <= size - pixelOffset;
+    if (!ok) {
+        std::cout << "pack " << path << " is corrupt" << std::endl;
+        clear();
+        return false;
+    }
+
+    mPixels = data + pixelOffset;
+    mSlabBytes = pixelBytes;
+    for (int l = 0, k = 0; l < levels; l++) {
+        for (int i = 0; i < count; i++, k++) {
+            SrcImage& img = mLevels[l][i];
+            if (offsets[k] > pixelBytes || (uint64_t)img.pitch * img.height > pixelBytes - offsets[k]
+                    || img.pitch < img.width * 4) {
+                std::cout << "pack " << path << " is corrupt" << std::endl;
+                clear();
+                return false;
+            }
+            img.data = (uint8_t*)mPixels + offsets[k];
+            img.path = mPaths[i];
+        }
+    }
+    mPack = std::move(file);
+    return true;
+}
@@ -0,0 +1,109 @@
+#ifndef IMAGESTORE_H
+#define IMAGESTORE_H
+
+#include "utils.h"
+#include "MappedFile.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define PACK_MAGIC 0x4B504947 // "GIPK"
+#define PACK_VERSION 1
+
+// Per image statistics over the decoded pixels
+struct ImageStats {
+    float mean[3]; // b, g, r
+    float lumaStddev;
+};
+
+struct DecodeTiming {
+    int readUs;
+    int decodeUs;
+    int resampleUs;
+};
+
+// Per stage times are summed over workers, wall is elapsed time
+struct LoadTiming {
+    int images;
+    int failed;
+    double readMs;
+    double decodeMs;
+    double resampleMs;
+    double wallMs;
+};
+
+// Owns a library of source images at several resolutions in one 64-byte aligned slab.
+// Rows are padded to 64 bytes (pitch may exceed width * 4). An image ID is its index
+// in the path list passed to load(), a file that fails to decode keeps its ID as a 1x1
+// transparent image, so IDs in checkpoints and migrants stay valid across runs.
+// (id, level) resolves to a view in O(1).
+class ImageStore
+{
+    public:
+        ImageStore();
+        virtual ~ImageStore();
+
+        // Decodes each file once and keeps it at every pixel budget, level l = pxBudgets[l]
+        bool load(const std::vector<std::string>& paths, const std::vector<long long>& pxBudgets);
+        void clear();
+        // Drops an image from every level, later IDs move down by one. Its pixels stay
+        // in the slab or mapping until clear().
+        void exclude(int id);
+
+        // Pack file: header, index and stats, then the slab as is at a page aligned offset.
+        // loadPack maps it and points the views into the mapping, nothing is copied.
+        bool savePack(const std::string& path) const;
+        bool loadPack(const std::string& path);
+
+        int imageCount() const { return mPaths.size(); }
+        int levelCount() const { return mLevels.size(); }
+        const SrcImage& get(int id, int level) const { return mLevels[level][id]; }
+        // Views of every image at a level indexed by ID, what Habitat takes as refImages
+        const std::vector<SrcImage>* level(int level) const { return &mLevels[level]; }
+        const std::string& path(int id) const { return mPaths[id]; }
+        const ImageStats& stats(int id) const { return mStats[id]; }
+        long long budget(int level) const { return mBudgets[level]; }
+        size_t bytes() const { return mSlabBytes; }
+        const LoadTiming& timing() const { return mTiming; }
+
+    private:
+        uint8_t* mSlab; // owned, NULL when pixels live in mPack
+        const uint8_t* mPixels;
+        size_t mSlabBytes;
+        std::unique_ptr<MappedFile> mPack;
+        std::vector<long long> mBudgets;
+        std::vector<ImageStats> mStats;
+        LoadTiming mTiming;
+        std::vector<std::string> mPaths;
+        std::vector<std::vector<SrcImage>> mLevels;
+
+        ImageStore(const ImageStore&);
+        ImageStore& operator=(const ImageStore&);
+};
+
+// One image decoded once and resampled to several pixel budgets.
+// Rows are tightly packed, levels[l].data points into pixels[l].
+struct DecodedImage {
+    ImageStats stats;
+    std::vector<SrcImage> levels;
+    std::vector<std::vector<uint8_t>> pixels;
+};
+
+// Decodes at a reduced size (JPEG DCT scaling) when every budget allows, then area-resamples
+bool decode_image(const std::string& path, const std::vector<long long>& pxBudgets, DecodedImage& out,
+                  DecodeTiming* pTiming = NULL);
+// 1x1 transparent stand-in at every level for a file that did not decode
+void placeholder_image(const std::string& path, int levels, DecodedImage& out);
+// Decodes on a fixed set of workers with one image in flight each, sink runs on the worker
+void decode_images(const std::vector<std::string>& paths, const std::vector<long long>& pxBudgets,
+                   const std::function<void(int, DecodedImage&)>& sink, LoadTiming* pTiming = NULL);
+// Row length in bytes padded to 64
+int aligned_pitch(int width);
+// Copies src rows to dst, zeroing the padding of every row
+void copy_rows(const SrcImage& src, uint8_t* dst, int dstPitch);
+
+// Image files of a directory sorted by name, so IDs do not depend on directory order
+std::vector<std::string> list_images(const std::string& dir);
+
+#endif // IMAGESTORE_H
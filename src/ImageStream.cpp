@@ -0,0 +1,226 @@
+#include "ImageStream.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+
+static const int PREFETCH_QUEUE_MAX = 4096;
+
+enum SlotState {
+    SLOT_RESIDENT = 1,
+    SLOT_LOADING = 2,
+    SLOT_REFERENCED = 4 // used since the clock hand last passed
+};
+
+StreamedImage::~StreamedImage() {
+    if (img.data)
+        _mm_free(img.data);
+}
+
+ImageStream::ImageStream(const std::vector<std::string>& paths, long long pxBudget, long long thumbBudget,
+                         size_t memoryBudget) {
+    mPaths = paths;
+    mPxBudget = pxBudget;
+    mThumbBudget = thumbBudget;
+    mMemoryBudget = memoryBudget;
+    mBytes = 0;
+    mResident = 0;
+    mHand = 0;
+    mStop = false;
+    for (int i = 0; i < STREAM_SHARDS; i++) {
+        mShards[i].hits = 0;
+        mShards[i].misses = 0;
+    }
+}
+
+ImageStream::~ImageStream() {
+    {
+        std::lock_guard<std::mutex> lock(mPrefetchMutex);
+        mStop = true;
+    }
+    mPrefetchCond.notify_all();
+    if (mPrefetchThread.joinable())
+        mPrefetchThread.join();
+}
+
+bool ImageStream::open() {
+    std::vector<DecodedImage> decoded(mPaths.size());
+    std::vector<char> ok(mPaths.size(), 0);
+    decode_images(mPaths, {mPxBudget, mThumbBudget}, [&](int i, DecodedImage& d) {
+        // keep the thumbnail only
+        d.pixels[0].clear();
+        d.pixels[0].shrink_to_fit();
+        d.levels[0].data = NULL;
+        decoded[i] = std::move(d);
+        ok[i] = 1;
+    });
+
+    // failed files keep their ID as a 1x1 transparent image, as in ImageStore
+    if (std::find(ok.begin(), ok.end(), 1) == ok.end())
+        return false;
+    for (int i = 0; i < decoded.size(); i++) {
+        if (!ok[i])
+            placeholder_image(mPaths[i], 2, decoded[i]);
+        SrcImage meta = decoded[i].levels[0];
+        meta.pitch = aligned_pitch(meta.width);
+        mMeta.push_back(meta);
+        mThumbPixels.push_back(std::move(decoded[i].pixels[1]));
+        mThumbs.push_back(decoded[i].levels[1]);
+        mThumbs.back().data = mThumbPixels.back().data();
+        mStats.push_back(decoded[i].stats);
+    }
+    mSlots.resize(mMeta.size());
+    mState = std::vector<std::atomic<uint8_t>>(mMeta.size());
+
+    mPrefetchThread = std::thread(&ImageStream::prefetchLoop, this);
+    return !mMeta.empty();
+}
+
+std::shared_ptr<const StreamedImage> ImageStream::acquire(int id) {
+    Shard& shard = mShards[id % STREAM_SHARDS];
+    Slot& slot = mSlots[id];
+    std::promise<ImagePtr> promise;
+    std::shared_future<ImagePtr> pending;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (slot.image) {
+            shard.hits.fetch_add(1, std::memory_order_relaxed);
+            if (!(mState[id].load(std::memory_order_relaxed) & SLOT_REFERENCED))
+                mState[id].fetch_or(SLOT_REFERENCED, std::memory_order_relaxed);
+            return slot.image;
+        }
+        if (slot.loading.valid()) {
+            pending = slot.loading;
+        } else {
+            shard.misses.fetch_add(1, std::memory_order_relaxed);
+            slot.loading = promise.get_future().share();
+            mState[id].store(SLOT_LOADING, std::memory_order_relaxed);
+        }
+    }
+    if (pending.valid())
+        return pending.get();
+
+    ImagePtr image;
+    try {
+        image = decode(id);
+    } catch (...) {
+        // waiters get the error too, and the next acquire retries the decode
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            slot.loading = std::shared_future<ImagePtr>();
+            mState[id].store(0, std::memory_order_relaxed);
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        slot.image = image;
+        slot.loading = std::shared_future<ImagePtr>();
+        mState[id].store(SLOT_RESIDENT | SLOT_REFERENCED, std::memory_order_relaxed);
+    }
+    mBytes += (size_t)image->img.pitch * image->img.height;
+    mResident++;
+    promise.set_value(image);
+    evict();
+    return image;
+}
+
+// Clock sweep until the cache fits its budget: an image used since the hand last
+// passed only loses its bit, the last resident image is always kept
+void ImageStream::evict() {
+    if (mBytes <= mMemoryBudget)
+        return;
+    std::lock_guard<std::mutex> evictLock(mEvictMutex);
+    int n = mSlots.size();
+    for (int step = 0; step < 2 * n && mBytes > mMemoryBudget && mResident > 1; step++) {
+        int id = mHand;
+        mHand = (mHand + 1) % n;
+        uint8_t state = mState[id].load(std::memory_order_relaxed);
+        if (!(state & SLOT_RESIDENT))
+            continue;
+        if (state & SLOT_REFERENCED) {
+            mState[id].fetch_and(~SLOT_REFERENCED, std::memory_order_relaxed);
+            continue;
+        }
+
+        // freed once the last holder lets go, outside the shard lock
+        ImagePtr victim;
+        {
+            std::lock_guard<std::mutex> lock(mShards[id % STREAM_SHARDS].mutex);
+            if (mState[id].load(std::memory_order_relaxed) != SLOT_RESIDENT)
+                continue; // used again since the check
+            victim.swap(mSlots[id].image);
+            mState[id].store(0, std::memory_order_relaxed);
+        }
+        mBytes -= (size_t)victim->img.pitch * victim->img.height;
+        mResident--;
+    }
+}
+
+void ImageStream::prefetch(const std::vector<int>& ids) {
+    {
+        std::lock_guard<std::mutex> lock(mPrefetchMutex);
+        for (int i = 0; i < ids.size() && mPrefetchQueue.size() < PREFETCH_QUEUE_MAX; i++) {
+            if (mState[ids[i]].load(std::memory_order_relaxed) == 0)
+                mPrefetchQueue.push_back(ids[i]);
+        }
+    }
+    mPrefetchCond.notify_all();
+}
+
+uint64_t ImageStream::hits() const {
+    uint64_t sum = 0;
+    for (int i = 0; i < STREAM_SHARDS; i++) {
+        sum += mShards[i].hits.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+uint64_t ImageStream::misses() const {
+    uint64_t sum = 0;
+    for (int i = 0; i < STREAM_SHARDS; i++) {
+        sum += mShards[i].misses.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+std::shared_ptr<const StreamedImage> ImageStream::decode(int id) {
+    std::shared_ptr<StreamedImage> out = std::make_shared<StreamedImage>();
+    out->img = mMeta[id];
+    size_t bytes = (size_t)out->img.pitch * out->img.height;
+    out->img.data = (uint8_t*)_mm_malloc(bytes, 64);
+    if (out->img.data == NULL)
+        throw std::bad_alloc();
+
+    DecodedImage decoded;
+    if (decode_image(mPaths[id], {mPxBudget}, decoded) && decoded.levels[0].width == out->img.width
+            && decoded.levels[0].height == out->img.height) {
+        copy_rows(decoded.levels[0], out->img.data, out->img.pitch);
+    } else {
+        // file changed or vanished since open(), draw it transparent
+        memset(out->img.data, 0, bytes);
+    }
+    return out;
+}
+
+void ImageStream::prefetchLoop() {
+    std::unique_lock<std::mutex> lock(mPrefetchMutex);
+    while (true) {
+        mPrefetchCond.wait(lock, [&] { return mStop || !mPrefetchQueue.empty(); });
+        if (mStop)
+            break;
+        int id = mPrefetchQueue.front();
+        mPrefetchQueue.pop_front();
+        if (mState[id].load(std::memory_order_relaxed) != 0)
+            continue;
+        lock.unlock();
+        try {
+            acquire(id);
+        } catch (const std::exception& e) {
+            // a prefetch is only a hint, the drawing thread retries and sees the error
+            std::cout << "prefetch of " << mPaths[id] << " failed: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef IMAGESTREAM_H
+#define IMAGESTREAM_H
+
+#include "ImageStore.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#define STREAM_SHARDS 64
+
+// Full resolution pixels of one streamed image, 64-byte aligned rows
+struct StreamedImage {
+    SrcImage img;
+
+    StreamedImage() { img.data = NULL; }
+    ~StreamedImage();
+};
+
+// Library too big to keep decoded. Only metadata, stats and a thumbnail per image stay
+// resident; pixels at the drawing resolution are decoded on demand into a cache bounded
+// by memoryBudget bytes. Images in use are never freed under a caller, so the budget can
+// be exceeded by what is currently held. A background thread decodes prefetched IDs
+// ahead of use.
+// acquire() is called for every layer drawn, so a hit only takes the lock of one of
+// STREAM_SHARDS shards and sets a used bit; eviction is a clock sweep over those bits
+// (approximate LRU) run by the thread that missed.
+class ImageStream
+{
+    public:
+        ImageStream(const std::vector<std::string>& paths, long long pxBudget, long long thumbBudget,
+                    size_t memoryBudget);
+        virtual ~ImageStream();
+
+        // One parallel pass over all files for metadata and thumbnails
+        bool open();
+
+        int imageCount() { return mMeta.size(); }
+        // Sizes at the drawing resolution, data is NULL. Image IDs are indexes here.
+        const std::vector<SrcImage>* metadata() { return &mMeta; }
+        const std::vector<SrcImage>* thumbnails() { return &mThumbs; }
+        const ImageStats& stats(int id) { return mStats[id]; }
+
+        // Blocks on a miss, concurrent misses of one image decode it once
+        std::shared_ptr<const StreamedImage> acquire(int id);
+        void prefetch(const std::vector<int>& ids);
+
+        uint64_t hits() const;
+        uint64_t misses() const;
+        size_t bytesResident() const { return mBytes; }
+
+    private:
+        typedef std::shared_ptr<const StreamedImage> ImagePtr;
+        // Guarded by the shard of its ID
+        struct Slot {
+            ImagePtr image;
+            std::shared_future<ImagePtr> loading;
+        };
+        struct alignas(64) Shard {
+            std::mutex mutex;
+            std::atomic<uint64_t> hits;
+            std::atomic<uint64_t> misses;
+        };
+
+        ImagePtr decode(int id);
+        void evict();
+        void prefetchLoop();
+
+        std::vector<std::string> mPaths;
+        long long mPxBudget;
+        long long mThumbBudget;
+        size_t mMemoryBudget;
+
+        std::vector<SrcImage> mMeta;
+        std::vector<SrcImage> mThumbs;
+        std::vector<std::vector<uint8_t>> mThumbPixels;
+        std::vector<ImageStats> mStats;
+
+        Shard mShards[STREAM_SHARDS];
+        std::vector<Slot> mSlots;
+        std::vector<std::atomic<uint8_t>> mState; // SLOT_* bits per ID, read without locks
+        std::atomic<size_t> mBytes;
+        std::atomic<int> mResident;
+
+        std::mutex mEvictMutex; // one sweep at a time
+        int mHand;
+
+        std::mutex mPrefetchMutex; // guards the queue and mStop
+        std::deque<int> mPrefetchQueue;
+        std::condition_variable mPrefetchCond;
+        bool mStop;
+        std::thread mPrefetchThread;
+};
+
+#endif // IMAGESTREAM_H
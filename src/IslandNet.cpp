@@ -0,0 +1,388 @@
+#include "IslandNet.h"
+#include "GenomeWire.h"
+#include <iostream>
+
+#ifdef _WIN32
+#include <winsock2.h> // link with ws2_32
+#include <ws2tcpip.h>
+#define NET_INVALID ((NetSocket)INVALID_SOCKET)
+static void net_close(NetSocket s) { closesocket((SOCKET)s); }
+static void net_shutdown(NetSocket s) { shutdown((SOCKET)s, SD_BOTH); }
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#define NET_INVALID ((NetSocket)-1)
+static void net_close(NetSocket s) { close((int)s); }
+static void net_shutdown(NetSocket s) { shutdown((int)s, SHUT_RDWR); }
+#endif
+
+#define NET_MAGIC 0x474D4947 // "GIMG"
+#define NET_MAX_PAYLOAD (64 << 20)
+
+enum NetMessage {
+    NET_SUBMIT = 1,  // worker -> coordinator: u64 best fitness, u32 level, u32 groups, genes per group
+    NET_MIGRANTS = 2 // coordinator -> worker: u32 groups, genes per group
+};
+
+static void net_init() {
+#ifdef _WIN32
+    static bool done = false;
+    static std::mutex m;
+    std::lock_guard<std::mutex> lock(m);
+    if (!done) {
+        WSADATA wsa;
+        WSAStartup(MAKEWORD(2, 2), &wsa);
+        done = true;
+    }
+#endif
+}
+
+static bool net_send_all(NetSocket s, const uint8_t* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        int n = send((SOCKET)s, (const char*)data, size, 0);
+#else
+        ssize_t n = send((int)s, data, size, MSG_NOSIGNAL);
+#endif
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool net_recv_all(NetSocket s, uint8_t* data, size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        int n = recv((SOCKET)s, (char*)data, size, 0);
+#else
+        ssize_t n = recv((int)s, data, size, 0);
+#endif
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Frame: u32 magic, u32 type, u32 payload size, payload
+static bool net_send_msg(NetSocket s, uint32_t type, const std::vector<uint8_t>& payload) {
+    std::vector<uint8_t> frame;
+    frame.reserve(12 + payload.size());
+    wire_put_u32(frame, NET_MAGIC);
+    wire_put_u32(frame, type);
+    wire_put_u32(frame, payload.size());
+    frame.insert(frame.end(), payload.begin(), payload.end());
+    return net_send_all(s, frame.data(), frame.size());
+}
+
+static bool net_recv_msg(NetSocket s, uint32_t* pType, std::vector<uint8_t>& payload) {
+    uint8_t header[12];
+    if (!net_recv_all(s, header, 12))
+        return false;
+    size_t pos = 0;
+    uint32_t magic, size;
+    wire_get_u32(header, 12, &pos, &magic);
+    wire_get_u32(header, 12, &pos, pType);
+    wire_get_u32(header, 12, &pos, &size);
+    if (magic != NET_MAGIC || size > NET_MAX_PAYLOAD)
+        return false;
+    payload.resize(size);
+    return net_recv_all(s, payload.data(), size);
+}
+
+IslandCoordinator::IslandCoordinator(int port) {
+    mPort = port;
+    mListen = NET_INVALID;
+    mStop = false;
+    mBestFitness = UINT64_MAX;
+    mBestLevel = -1;
+    mBestWorker = -1;
+    mSubmissions = 0;
+}
+
+IslandCoordinator::~IslandCoordinator() {
+    stop();
+}
+
+bool IslandCoordinator::start() {
+    net_init();
+    NetSocket s = (NetSocket)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == NET_INVALID)
+        return false;
+
+    int yes = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(mPort);
+    if (bind(s, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(s, 16) != 0) {
+        std::cout << "coordinator could not listen on port " << mPort << std::endl;
+        net_close(s);
+        return false;
+    }
+
+    mListen = s;
+    mStop = false;
+    mAcceptThread = std::thread(&IslandCoordinator::acceptLoop, this);
+    return true;
+}
+
+void IslandCoordinator::stop() {
+    if (mListen == NET_INVALID)
+        return;
+    mStop = true;
+    net_shutdown(mListen);
+    net_close(mListen);
+    mAcceptThread.join();
+    mListen = NET_INVALID;
+
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (int i = 0; i < mWorkerSockets.size(); i++) {
+            net_shutdown(mWorkerSockets[i]);
+        }
+        threads.swap(mWorkerThreads);
+    }
+    for (int i = 0; i < threads.size(); i++) {
+        if (threads[i].joinable())
+            threads[i].join();
+    }
+    // serve closed every socket on its way out
+    std::lock_guard<std::mutex> lock(mMutex);
+    mWorkerSockets.clear();
+    mLatest.clear();
+    mBestWorker = -1;
+}
+
+uint64_t IslandCoordinator::getBestFitness() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mBestFitness;
+}
+
+int IslandCoordinator::getBestLevel() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mBestLevel;
+}
+
+std::vector<Individual> IslandCoordinator::getBestGenes() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mBestGenes;
+}
+
+int IslandCoordinator::getWorkerCount() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    int live = 0;
+    for (int i = 0; i < mWorkerSockets.size(); i++) {
+        if (mWorkerSockets[i] != NET_INVALID)
+            live++;
+    }
+    return live;
+}
+
+uint64_t IslandCoordinator::getSubmissions() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSubmissions;
+}
+
+void IslandCoordinator::acceptLoop() {
+    while (!mStop) {
+        NetSocket s = (NetSocket)accept(mListen, NULL, NULL);
+        if (s == NET_INVALID)
+            break;
+        if (mStop) {
+            net_close(s);
+            break;
+        }
+        int yes = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(yes));
+
+        // a disconnected worker's slot is reused, its serve thread has returned or is about to
+        std::thread finished;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            int worker = 0;
+            while (worker < mWorkerSockets.size() && mWorkerSockets[worker] != NET_INVALID)
+                worker++;
+            if (worker == mWorkerSockets.size()) {
+                mWorkerSockets.push_back(NET_INVALID);
+                mLatest.emplace_back();
+                mWorkerThreads.emplace_back();
+            }
+            finished.swap(mWorkerThreads[worker]);
+            mWorkerSockets[worker] = s;
+            mWorkerThreads[worker] = std::thread(&IslandCoordinator::serve, this, s, worker);
+        }
+        if (finished.joinable())
+            finished.join();
+    }
+}
+
+void IslandCoordinator::serve(NetSocket sock, int worker) {
+    uint32_t type;
+    std::vector<uint8_t> payload;
+    while (!mStop && net_recv_msg(sock, &type, payload)) {
+        if (type != NET_SUBMIT)
+            break;
+
+        size_t pos = 0;
+        uint64_t fitness;
+        uint32_t level, groups;
+        if (!wire_get_u64(payload.data(), payload.size(), &pos, &fitness)
+                || !wire_get_u32(payload.data(), payload.size(), &pos, &level)
+                || !wire_get_u32(payload.data(), payload.size(), &pos, &groups))
+            break;
+        std::vector<std::vector<Individual>> submitted(std::min(groups, (uint32_t)payload.size()));
+        bool ok = true;
+        for (int i = 0; i < submitted.size() && ok; i++) {
+            ok = wire_get_genes(payload.data(), payload.size(), &pos, submitted[i]);
+        }
+        if (!ok)
+            break;
+
+        std::vector<uint8_t> reply;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mSubmissions++;
+            if (!submitted.empty()) {
+                mLatest[worker] = submitted[0];
+                // fitness sums pixels, so it only compares within a resolution level
+                if ((int)level > mBestLevel || ((int)level == mBestLevel && fitness < mBestFitness)) {
+                    mBestFitness = fitness;
+                    mBestLevel = level;
+                    mBestGenes = submitted[0];
+                    mBestWorker = worker;
+                }
+            }
+
+            // Global best first, then the latest best of the other workers, starting after this one
+            std::vector<const std::vector<Individual>*> migrants;
+            if (!mBestGenes.empty() && mBestWorker != worker)
+                migrants.push_back(&mBestGenes);
+            int n = mLatest.size();
+            for (int i = 1; i < n && migrants.size() < submitted.size(); i++) {
+                int w = (worker + i) % n;
+                if (w != mBestWorker && !mLatest[w].empty())
+                    migrants.push_back(&mLatest[w]);
+            }
+            if (migrants.size() > submitted.size())
+                migrants.resize(submitted.size());
+
+            wire_put_u32(reply, migrants.size());
+            for (int i = 0; i < migrants.size(); i++) {
+                wire_put_genes(reply, *migrants[i]);
+            }
+        }
+        if (!net_send_msg(sock, NET_MIGRANTS, reply))
+            break;
+    }
+
+    // a dead worker's genomes are no longer sent as migrants, the global best is kept
+    std::lock_guard<std::mutex> lock(mMutex);
+    mWorkerSockets[worker] = NET_INVALID;
+    mLatest[worker].clear();
+    if (mBestWorker == worker)
+        mBestWorker = -1;
+    net_shutdown(sock);
+    net_close(sock);
+}
+
+IslandWorker::IslandWorker(const std::string& host, int port) {
+    mHost = host;
+    mPort = port;
+    mSock = NET_INVALID;
+    mMigrantsIn = 0;
+}
+
+IslandWorker::~IslandWorker() {
+    disconnect();
+}
+
+bool IslandWorker::connect() {
+    net_init();
+    disconnect();
+
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = NULL;
+    if (getaddrinfo(mHost.c_str(), std::to_string(mPort).c_str(), &hints, &res) != 0)
+        return false;
+
+    NetSocket s = (NetSocket)socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (s != NET_INVALID && ::connect(s, res->ai_addr, res->ai_addrlen) != 0) {
+        net_close(s);
+        s = NET_INVALID;
+    }
+    freeaddrinfo(res);
+    if (s == NET_INVALID) {
+        std::cout << "could not connect to coordinator " << mHost << ":" << mPort << std::endl;
+        return false;
+    }
+
+    int yes = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(yes));
+    mSock = s;
+    return true;
+}
+
+void IslandWorker::disconnect() {
+    if (mSock == NET_INVALID)
+        return;
+    net_shutdown(mSock);
+    net_close(mSock);
+    mSock = NET_INVALID;
+}
+
+bool IslandWorker::connected() {
+    return mSock != NET_INVALID;
+}
+
+bool IslandWorker::exchange(Habitat& hab, int migrants) {
+    if (mSock == NET_INVALID)
+        return false;
+
+    std::vector<uint64_t> fitness;
+    std::vector<std::vector<Individual>> top = hab.topGenomes(migrants, &fitness);
+
+    std::vector<uint8_t> payload;
+    wire_put_u64(payload, fitness.empty() ? UINT64_MAX : fitness[0]);
+    wire_put_u32(payload, hab.getLevel());
+    wire_put_u32(payload, top.size());
+    for (int i = 0; i < top.size(); i++) {
+        wire_put_genes(payload, top[i]);
+    }
+
+    uint32_t type;
+    std::vector<uint8_t> reply;
+    if (!net_send_msg(mSock, NET_SUBMIT, payload) || !net_recv_msg(mSock, &type, reply)
+            || type != NET_MIGRANTS) {
+        disconnect();
+        return false;
+    }
+
+    size_t pos = 0;
+    uint32_t groups;
+    if (!wire_get_u32(reply.data(), reply.size(), &pos, &groups)) {
+        disconnect();
+        return false;
+    }
+    std::vector<Individual> genes;
+    for (int i = 0; i < groups; i++) {
+        if (!wire_get_genes(reply.data(), reply.size(), &pos, genes)) {
+            disconnect();
+            return false;
+        }
+        hab.immigrate(genes);
+        mMigrantsIn++;
+    }
+    return true;
+}
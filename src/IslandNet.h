@@ -0,0 +1,77 @@
+#ifndef ISLANDNET_H
+#define ISLANDNET_H
+
+#include "Habitat.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Island model across processes or hosts over TCP. Workers run their own Habitat and
+// periodically submit their best groups to a coordinator; the reply carries a migrant
+// from another worker. Only genomes cross the link, migrants are re-rendered locally.
+// All workers must share the target image, library order and resolution levels. The
+// global best is the best group at the highest level any worker has reached.
+
+typedef intptr_t NetSocket;
+
+class IslandCoordinator
+{
+    public:
+        IslandCoordinator(int port);
+        virtual ~IslandCoordinator();
+
+        bool start();
+        void stop();
+
+        uint64_t getBestFitness();
+        int getBestLevel(); // -1 before the first submission
+        std::vector<Individual> getBestGenes();
+        int getWorkerCount();
+        uint64_t getSubmissions();
+
+    private:
+        void acceptLoop();
+        void serve(NetSocket sock, int worker);
+
+        int mPort;
+        NetSocket mListen;
+        std::atomic<bool> mStop;
+        std::thread mAcceptThread;
+
+        std::mutex mMutex; // guards everything below
+        std::vector<std::thread> mWorkerThreads;
+        std::vector<NetSocket> mWorkerSockets;
+        std::vector<std::vector<Individual>> mLatest; // last submitted best per worker
+        std::vector<Individual> mBestGenes;
+        uint64_t mBestFitness;
+        int mBestLevel;
+        int mBestWorker;
+        uint64_t mSubmissions;
+};
+
+class IslandWorker
+{
+    public:
+        IslandWorker(const std::string& host, int port);
+        virtual ~IslandWorker();
+
+        bool connect();
+        void disconnect();
+        bool connected();
+
+        // Sends the best groups of hab and immigrates the coordinator's reply.
+        // Blocks for one round trip, false if the link is down.
+        bool exchange(Habitat& hab, int migrants);
+
+        uint64_t migrantsIn() const { return mMigrantsIn; }
+
+    private:
+        std::string mHost;
+        int mPort;
+        NetSocket mSock;
+        uint64_t mMigrantsIn;
+};
+
+#endif // ISLANDNET_H
@@ -0,0 +1,32 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+    public:
+        MappedFile();
+        virtual ~MappedFile();
+
+        bool open(const std::string& path);
+        void close();
+
+        const uint8_t* data() const { return mData; }
+        size_t size() const { return mSize; }
+
+    private:
+        const uint8_t* mData;
+        size_t mSize;
+#ifdef _WIN32
+        void* mFile;
+        void* mMapping;
+#endif
+
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,57 @@
+#include "PlacementSearch.h"
+#include "rotate.h"
+#include <execution>
+#include <numeric>
+
+PlacementSearch::PlacementSearch(const SrcImage* target) {
+    mTarget = target;
+}
+
+PlacementSearch::~PlacementSearch() {
+    //dtor
+}
+
+PlacementScore PlacementSearch::score(const SrcImage& sprite, const uint8_t* canvas, const Placement& p) {
+    PlacementScore out = PlacementScore{-1, 0, 0, 0};
+    if (sprite.width == 0 || sprite.height == 0 || p.scale <= 0)
+        return out;
+
+    // bounds, row spans and the fused sample + SAD rows all come from rotate.cpp,
+    // so the score covers exactly the pixels RotateDrawClip would draw
+    if (!RotateScoreClip((const RotatePixel_t*)mTarget->data, (const RotatePixel_t*)canvas,
+                         mTarget->width, mTarget->height, mTarget->pitch,
+                         (const RotatePixel_t*)sprite.data, sprite.width, sprite.height, sprite.pitch,
+                         p.x, p.y, 0, 0, p.angle, p.scale, &out.spriteSad, &out.canvasSad))
+        return out;
+
+    out.index = 0;
+    out.gain = (int64_t)out.canvasSad - (int64_t)out.spriteSad;
+    return out;
+}
+
+static PlacementScore better(const PlacementScore& a, const PlacementScore& b) {
+    if (a.index < 0)
+        return b;
+    if (b.index < 0)
+        return a;
+    if (a.gain != b.gain)
+        return a.gain > b.gain ? a : b;
+    return a.index < b.index ? a : b;
+}
+
+PlacementScore PlacementSearch::best(const SrcImage& sprite, const uint8_t* canvas,
+                                     const std::vector<Placement>& candidates, bool parallel) {
+    auto scoreAt = [&](int i) {
+        PlacementScore s = score(sprite, canvas, candidates[i]);
+        if (s.index == 0)
+            s.index = i;
+        return s;
+    };
+    PlacementScore none = PlacementScore{-1, 0, 0, 0};
+
+    std::vector<int> ids(candidates.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    if (!parallel)
+        return std::transform_reduce(ids.begin(), ids.end(), none, better, scoreAt);
+    return std::transform_reduce(std::execution::par, ids.begin(), ids.end(), none, better, scoreAt);
+}
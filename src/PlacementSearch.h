@@ -0,0 +1,42 @@
+#ifndef PLACEMENTSEARCH_H
+#define PLACEMENTSEARCH_H
+
+#include "utils.h"
+#include <vector>
+
+// One transform of a sprite, same convention as RotateDrawClip with source rotation center (0, 0)
+struct Placement {
+    float x;     // destination pixel source (0, 0) lands on
+    float y;
+    float angle;
+    float scale; // destination pixels per source pixel
+};
+
+struct PlacementScore {
+    int index;          // into the candidates, -1 when none covers a pixel
+    int64_t gain;       // canvasSad - spriteSad, positive when drawing the sprite helps
+    uint64_t spriteSad; // target against the sprite under its footprint
+    uint64_t canvasSad; // target against the current canvas under the same footprint
+};
+
+// Scores candidate placements of one sprite against a target and the canvas drawn so far.
+// Every candidate is sampled and compared in one pass over its footprint, one row span
+// at a time; threads keep their own best and a single reduction picks the winner
+// (highest gain, lowest index on ties), so the result does not depend on scheduling.
+class PlacementSearch
+{
+    public:
+        // Canvas passed to the queries has the target's size and pitch
+        PlacementSearch(const SrcImage* target);
+        virtual ~PlacementSearch();
+
+        PlacementScore score(const SrcImage& sprite, const uint8_t* canvas, const Placement& p);
+        // parallel splits candidates over threads, leave it off when already inside a parallel loop
+        PlacementScore best(const SrcImage& sprite, const uint8_t* canvas,
+                            const std::vector<Placement>& candidates, bool parallel = true);
+
+    private:
+        const SrcImage* mTarget;
+};
+
+#endif // PLACEMENTSEARCH_H
@@ -0,0 +1,153 @@
+#include "Preview.h"
+#include "metrics.h"
+#include <SDL.h>
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+
+static const int FRESH = 4;
+
+TripleBuffer::TripleBuffer() {
+    mBack = 0;
+    mMiddle = 1;
+    mFront = 2;
+}
+
+void TripleBuffer::publish() {
+    mBack = mMiddle.exchange(mBack | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
+
+bool TripleBuffer::fresh() const {
+    return mMiddle.load(std::memory_order_acquire) & FRESH;
+}
+
+bool TripleBuffer::acquire() {
+    if (!fresh())
+        return false;
+    mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & ~FRESH;
+    return true;
+}
+
+Preview::Preview(int winW, int winH, int maxFps) {
+    mWinW = winW;
+    mWinH = winH;
+    mFrameTime = std::chrono::microseconds(1000000 / std::max(maxFps, 1));
+    mTarget = NULL;
+    mStop = false;
+    mClosed = false;
+}
+
+Preview::~Preview() {
+    stop();
+}
+
+void Preview::start() {
+    if (mThread.joinable())
+        return;
+    mStop = false;
+    mThread = std::thread(&Preview::run, this);
+}
+
+void Preview::stop() {
+    mStop = true;
+    if (mThread.joinable())
+        mThread.join();
+}
+
+bool Preview::publish(const SrcImage* target, const uint8_t* canvas, uint64_t generation, uint64_t fitness) {
+    // nothing to do while the last frame waits to be shown or before the next one is due
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (mFrames.fresh() || now - mLastPublish < mFrameTime)
+        return false;
+    mLastPublish = now;
+
+    PreviewFrame& f = mFrames.back();
+    f.width = target->width;
+    f.height = target->height;
+    f.pitch = target->pitch;
+    f.generation = generation;
+    f.fitness = fitness;
+    f.pixels.resize((size_t)target->pitch * target->height);
+    simd_memcpy(f.pixels.data(), canvas, f.pixels.size());
+    mTarget = target;
+    mFrames.publish();
+    return true;
+}
+
+static void present(SDL_Renderer* renderer, SDL_Texture* texture) {
+    SDL_SetRenderDrawColor(renderer, 88, 88, 88, 255);
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+// Texture of w x h, reused while the size stays the same
+static SDL_Texture* streaming_texture(SDL_Renderer* renderer, SDL_Texture* texture, int* pW, int* pH, int w, int h) {
+    if (texture && *pW == w && *pH == h)
+        return texture;
+    if (texture)
+        SDL_DestroyTexture(texture);
+    *pW = w;
+    *pH = h;
+    return SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, w, h);
+}
+
+void Preview::run() {
+    // SDL windows and renderers are used only from the thread that made them
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0) {
+        std::cout << "preview disabled, SDL could not initialize: " << SDL_GetError() << std::endl;
+        return;
+    }
+    SDL_Window* windows[2];
+    SDL_Renderer* renderers[2];
+    for (int i = 0; i < 2; i++) {
+        windows[i] = SDL_CreateWindow(i == 0 ? "imageVimage" : "target", SDL_WINDOWPOS_UNDEFINED,
+                                      SDL_WINDOWPOS_UNDEFINED, mWinW, mWinH, SDL_WINDOW_SHOWN);
+        renderers[i] = windows[i] ? SDL_CreateRenderer(windows[i], -1, SDL_RENDERER_ACCELERATED) : NULL;
+    }
+    SDL_Texture* canvasTex = NULL;
+    SDL_Texture* targetTex = NULL;
+    int canvasW = 0, canvasH = 0, targetW = 0, targetH = 0;
+    const SrcImage* shownTarget = NULL;
+
+    while (!mStop) {
+        std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT || (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE))
+                mClosed = true;
+        }
+
+        if (renderers[0] && mFrames.acquire()) {
+            const PreviewFrame& f = mFrames.front();
+            canvasTex = streaming_texture(renderers[0], canvasTex, &canvasW, &canvasH, f.width, f.height);
+            SDL_UpdateTexture(canvasTex, NULL, f.pixels.data(), f.pitch);
+            present(renderers[0], canvasTex);
+            std::string title = "imageVimage - generation " + std::to_string(f.generation) +
+                                ", sad " + std::to_string(f.fitness);
+            SDL_SetWindowTitle(windows[0], title.c_str());
+        }
+
+        const SrcImage* target = mTarget;
+        if (renderers[1] && target != shownTarget) {
+            targetTex = streaming_texture(renderers[1], targetTex, &targetW, &targetH, target->width, target->height);
+            SDL_UpdateTexture(targetTex, NULL, target->data, target->pitch);
+            present(renderers[1], targetTex);
+            shownTarget = target;
+        }
+
+        std::this_thread::sleep_until(frameStart + mFrameTime);
+    }
+
+    if (canvasTex)
+        SDL_DestroyTexture(canvasTex);
+    if (targetTex)
+        SDL_DestroyTexture(targetTex);
+    for (int i = 0; i < 2; i++) {
+        if (renderers[i])
+            SDL_DestroyRenderer(renderers[i]);
+        if (windows[i])
+            SDL_DestroyWindow(windows[i]);
+    }
+    SDL_QuitSubSystem(SDL_INIT_VIDEO);
+}
@@ -0,0 +1,74 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "utils.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct PreviewFrame {
+    int width;
+    int height;
+    int pitch;
+    uint64_t generation;
+    uint64_t fitness;
+    std::vector<uint8_t> pixels;
+};
+
+// Latest-value handoff between one writer and one reader. The writer fills back() and
+// publishes it, the reader takes the newest published frame with acquire(). Each side
+// owns one frame and the third is swapped through an atomic, so neither ever waits;
+// frames the reader did not get to are overwritten.
+class TripleBuffer
+{
+    public:
+        TripleBuffer();
+
+        PreviewFrame& back() { return mFrames[mBack]; }
+        void publish();
+        bool fresh() const; // published frame the reader has not acquired yet
+
+        bool acquire();     // true when front() now holds a newer frame
+        const PreviewFrame& front() const { return mFrames[mFront]; }
+
+    private:
+        PreviewFrame mFrames[3];
+        int mBack;
+        int mFront;
+        std::atomic<int> mMiddle; // frame index, FRESH bit set by publish
+};
+
+// Live view of the best canvas next to the target, on its own thread. That thread owns
+// the windows, pumps their events and uploads into one streaming texture per window,
+// recreated only when the resolution level changes, at no more than maxFps.
+class Preview
+{
+    public:
+        Preview(int winW, int winH, int maxFps);
+        virtual ~Preview();
+
+        void start();
+        void stop();
+        bool closed() { return mClosed; } // a window was closed
+
+        // Copies canvas (target's size and pitch) for display if the preview is due a
+        // new frame, otherwise returns false at once. Never blocks.
+        bool publish(const SrcImage* target, const uint8_t* canvas, uint64_t generation, uint64_t fitness);
+
+    private:
+        TripleBuffer mFrames;
+        std::atomic<const SrcImage*> mTarget;
+        std::atomic<bool> mStop;
+        std::atomic<bool> mClosed;
+        std::thread mThread;
+        int mWinW;
+        int mWinH;
+        std::chrono::microseconds mFrameTime;
+        std::chrono::steady_clock::time_point mLastPublish;
+
+        void run();
+};
+
+#endif // PREVIEW_H
@@ -0,0 +1,156 @@
+#include "Profiler.h"
+#include <atomic>
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+static const char* const ZONE_NAMES[PROF_ZONES] = {
+    "step", "sort", "selection", "crossover", "mutate", "evaluate",
+    "clear", "render", "sad", "edges", "checkpoint"
+};
+static const int ZONE_PARENT[PROF_ZONES] = {
+    -1, PROF_STEP, PROF_STEP, PROF_STEP, PROF_STEP, PROF_STEP,
+    PROF_EVALUATE, PROF_EVALUATE, PROF_EVALUATE, PROF_EVALUATE, PROF_STEP
+};
+static const char* const COUNTER_NAMES[PROF_COUNTERS] = {
+    "generations", "evaluations", "pixels_rendered"
+};
+
+// Written only by the owning thread, so a relaxed load and store is enough; the
+// atomics just keep the reader from seeing torn values
+struct ThreadSlots {
+    std::atomic<uint64_t> ns[PROF_ZONES];
+    std::atomic<uint64_t> calls[PROF_ZONES];
+    std::atomic<uint64_t> counts[PROF_COUNTERS];
+};
+
+static std::mutex gRegistryMutex;
+// Never freed, totals of finished threads stay counted
+static std::vector<ThreadSlots*> gRegistry;
+// Start of the interval the next report covers, set when the first thread registers
+static Timer gInterval;
+
+static ThreadSlots* register_slots() {
+    ThreadSlots* s = new ThreadSlots();
+    for (int i = 0; i < PROF_ZONES; i++) {
+        s->ns[i] = 0;
+        s->calls[i] = 0;
+    }
+    for (int i = 0; i < PROF_COUNTERS; i++) {
+        s->counts[i] = 0;
+    }
+    std::lock_guard<std::mutex> lock(gRegistryMutex);
+    if (gRegistry.empty())
+        gInterval.start();
+    gRegistry.push_back(s);
+    return s;
+}
+
+static ThreadSlots& thread_slots() {
+    static thread_local ThreadSlots* slots = register_slots();
+    return *slots;
+}
+
+static inline void bump(std::atomic<uint64_t>& v, uint64_t n) {
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void profile_add(ProfileZone zone, uint64_t ns) {
+    ThreadSlots& s = thread_slots();
+    bump(s.ns[zone], ns);
+    bump(s.calls[zone], 1);
+}
+
+void profile_count(ProfileCounter counter, uint64_t n) {
+    bump(thread_slots().counts[counter], n);
+}
+
+ProfileTotals profile_totals() {
+    ProfileTotals t;
+    memset(&t, 0, sizeof(t));
+    std::lock_guard<std::mutex> lock(gRegistryMutex);
+    for (int k = 0; k < gRegistry.size(); k++) {
+        const ThreadSlots* s = gRegistry[k];
+        for (int i = 0; i < PROF_ZONES; i++) {
+            t.ns[i] += s->ns[i].load(std::memory_order_relaxed);
+            t.calls[i] += s->calls[i].load(std::memory_order_relaxed);
+        }
+        for (int i = 0; i < PROF_COUNTERS; i++) {
+            t.counts[i] += s->counts[i].load(std::memory_order_relaxed);
+        }
+    }
+    return t;
+}
+
+bool profile_report(std::ostream& out, bool json) {
+#ifndef PROFILER_ENABLED
+    (void)out;
+    (void)json;
+    return false;
+#else
+    static std::mutex reportMutex;
+    static ProfileTotals last = {};
+
+    std::lock_guard<std::mutex> lock(reportMutex);
+    ProfileTotals now = profile_totals();
+    double seconds = 0;
+    {
+        std::lock_guard<std::mutex> registryLock(gRegistryMutex);
+        if (!gRegistry.empty()) {
+            seconds = gInterval.getNanos() * 1e-9;
+            gInterval.start();
+        }
+    }
+
+    uint64_t ns[PROF_ZONES], calls[PROF_ZONES], counts[PROF_COUNTERS];
+    uint64_t childNs[PROF_ZONES] = {};
+    for (int i = 0; i < PROF_ZONES; i++) {
+        ns[i] = now.ns[i] - last.ns[i];
+        calls[i] = now.calls[i] - last.calls[i];
+        if (ZONE_PARENT[i] >= 0)
+            childNs[ZONE_PARENT[i]] += ns[i];
+    }
+    for (int i = 0; i < PROF_COUNTERS; i++) {
+        counts[i] = now.counts[i] - last.counts[i];
+    }
+    last = now;
+
+    char buf[256];
+    if (json) {
+        snprintf(buf, sizeof(buf), "{\"seconds\":%.6f,\"zones\":[", seconds);
+        out << buf;
+        for (int i = 0; i < PROF_ZONES; i++) {
+            uint64_t self = ns[i] > childNs[i] ? ns[i] - childNs[i] : 0;
+            snprintf(buf, sizeof(buf), "%s{\"zone\":\"%s\",\"parent\":\"%s\",\"calls\":%llu,\"ms\":%.3f,\"self_ms\":%.3f}",
+                     i ? "," : "", ZONE_NAMES[i], ZONE_PARENT[i] >= 0 ? ZONE_NAMES[ZONE_PARENT[i]] : "",
+                     (unsigned long long)calls[i], ns[i] * 1e-6, self * 1e-6);
+            out << buf;
+        }
+        out << "],\"counters\":{";
+        for (int i = 0; i < PROF_COUNTERS; i++) {
+            snprintf(buf, sizeof(buf), "%s\"%s\":%llu,\"%s_per_s\":%.1f", i ? "," : "",
+                     COUNTER_NAMES[i], (unsigned long long)counts[i],
+                     COUNTER_NAMES[i], seconds > 0 ? counts[i] / seconds : 0.0);
+            out << buf;
+        }
+        out << "}}" << std::endl;
+    } else {
+        snprintf(buf, sizeof(buf), "name,parent,calls,ms,self_ms,per_s\n");
+        out << buf;
+        for (int i = 0; i < PROF_ZONES; i++) {
+            uint64_t self = ns[i] > childNs[i] ? ns[i] - childNs[i] : 0;
+            snprintf(buf, sizeof(buf), "%s,%s,%llu,%.3f,%.3f,\n", ZONE_NAMES[i],
+                     ZONE_PARENT[i] >= 0 ? ZONE_NAMES[ZONE_PARENT[i]] : "",
+                     (unsigned long long)calls[i], ns[i] * 1e-6, self * 1e-6);
+            out << buf;
+        }
+        for (int i = 0; i < PROF_COUNTERS; i++) {
+            snprintf(buf, sizeof(buf), "%s,,%llu,,,%.1f\n", COUNTER_NAMES[i],
+                     (unsigned long long)counts[i], seconds > 0 ? counts[i] / seconds : 0.0);
+            out << buf;
+        }
+        out << std::flush;
+    }
+    return true;
+#endif
+}
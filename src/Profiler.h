@@ -0,0 +1,69 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "Timer.h"
+#include <ostream>
+#include <stdint.h>
+
+// Zones form a tree, see the parent table in Profiler.cpp
+enum ProfileZone {
+    PROF_STEP,
+    PROF_SORT,
+    PROF_SELECTION,
+    PROF_CROSSOVER,
+    PROF_MUTATE,
+    PROF_EVALUATE,
+    PROF_CLEAR,      // memset of the dirty region
+    PROF_RENDER,     // RotateDrawClip and the sprite cache
+    PROF_SAD,        // compute_sad against the target
+    PROF_EDGES,      // sobel and its compute_sad
+    PROF_CHECKPOINT,
+    PROF_ZONES
+};
+
+enum ProfileCounter {
+    PROF_GENERATIONS,
+    PROF_EVALUATIONS,
+    PROF_PIXELS_RENDERED,
+    PROF_COUNTERS
+};
+
+struct ProfileTotals {
+    uint64_t ns[PROF_ZONES];
+    uint64_t calls[PROF_ZONES];
+    uint64_t counts[PROF_COUNTERS];
+};
+
+void profile_add(ProfileZone zone, uint64_t ns);
+void profile_count(ProfileCounter counter, uint64_t n);
+// Sum over every thread that ever recorded
+ProfileTotals profile_totals();
+// Writes what was recorded since the previous report as one JSON line or a CSV block.
+// Zone times are summed over threads, so zones run inside parallel loops can exceed
+// their parent. Returns false and writes nothing when the profiler is compiled out.
+bool profile_report(std::ostream& out, bool json);
+
+// Adds the time from construction to destruction to zone
+class ProfileScope
+{
+    public:
+        ProfileScope(ProfileZone zone) { mZone = zone; mTimer.start(); }
+        ~ProfileScope() { profile_add(mZone, mTimer.getNanos()); }
+
+    private:
+        ProfileZone mZone;
+        Timer mTimer;
+};
+
+// Build with -DPROFILER_ENABLED to record, otherwise the macros expand to nothing
+#ifdef PROFILER_ENABLED
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(zone) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(zone)
+#define PROFILE_COUNT(counter, n) profile_count(counter, n)
+#else
+#define PROFILE_SCOPE(zone)
+#define PROFILE_COUNT(counter, n)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,39 @@
+#ifndef RNG_H
+#define RNG_H
+#include <stdint.h>
+
+// Counter based generator: n-th output is a pure function of (seed, stream, substream, n).
+// Each parallel work item makes its own Rng from ids that do not depend on scheduling,
+// so results are reproducible at any thread count and no lock is shared.
+class Rng
+{
+    public:
+        Rng(uint64_t seed, uint64_t stream, uint64_t substream = 0)
+                : mKey(mix(seed ^ mix(stream + 0x632be59bd9b4e019ULL) ^ mix(mix(substream) + 0x9e3779b97f4a7c15ULL))),
+                  mCounter(0) {
+        }
+
+        // Same range as rand() on every platform, [0, 2^31)
+        uint32_t next() {
+            return (uint32_t)(next64() >> 33);
+        }
+
+        uint64_t next64() {
+            return mix(mKey + (++mCounter) * 0x9e3779b97f4a7c15ULL);
+        }
+
+        uint64_t counter() const { return mCounter; }
+
+    private:
+        uint64_t mKey;
+        uint64_t mCounter;
+
+        // splitmix64 finalizer
+        static uint64_t mix(uint64_t z) {
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+};
+
+#endif // RNG_H
@@ -0,0 +1,238 @@
+#include "SimilarityIndex.h"
+#include <algorithm>
+#include <execution>
+#include <math.h>
+#include <numeric>
+#include <string.h>
+
+void describe_image(const SrcImage& img, ImageDescriptor& out) {
+    memset(out.v, 0, sizeof(out.v));
+    float* mean = out.v;
+    float* stddev = out.v + 3;
+    float* hist = out.v + 4;
+    float* grid = hist + 3 * DESC_BINS;
+    int count = img.width * img.height;
+    if (count == 0 || img.data == NULL)
+        return;
+
+    uint32_t cellPx[DESC_GRID * DESC_GRID] = {0};
+    double lumaSum = 0;
+    double lumaSq = 0;
+    for (int y = 0; y < img.height; y++) {
+        const uint8_t* row = img.data + (size_t)y * img.pitch;
+        float* cellRow = grid + y * DESC_GRID / img.height * DESC_GRID * 3;
+        uint32_t* cellCount = cellPx + y * DESC_GRID / img.height * DESC_GRID;
+        for (int x = 0; x < img.width; x++) {
+            const uint8_t* px = row + x * 4;
+            int cx = x * DESC_GRID / img.width;
+            for (int c = 0; c < 3; c++) {
+                mean[c] += px[c];
+                hist[c * DESC_BINS + px[c] * DESC_BINS / 256] += 1;
+                cellRow[cx * 3 + c] += px[c];
+            }
+            cellCount[cx]++;
+            float luma = 0.114f * px[0] + 0.587f * px[1] + 0.299f * px[2];
+            lumaSum += luma;
+            lumaSq += luma * luma;
+        }
+    }
+
+    for (int c = 0; c < 3; c++)
+        mean[c] /= 255.0f * count;
+    double lumaMean = lumaSum / count;
+    stddev[0] = sqrt(std::max(0.0, lumaSq / count - lumaMean * lumaMean)) / 127.5f;
+    for (int b = 0; b < 3 * DESC_BINS; b++)
+        hist[b] /= count;
+    // cells share the weight of one colour between them
+    for (int cell = 0; cell < DESC_GRID * DESC_GRID; cell++) {
+        float scale = cellPx[cell] ? 1.0f / (255.0f * DESC_GRID * cellPx[cell]) : 0;
+        for (int c = 0; c < 3; c++)
+            grid[cell * 3 + c] *= scale;
+    }
+}
+
+static float desc_dist(const ImageDescriptor& a, const ImageDescriptor& b) {
+    float sum = 0;
+    for (int i = 0; i < DESC_SIZE; i++) {
+        float d = a.v[i] - b.v[i];
+        sum += d * d;
+    }
+    return sqrtf(sum);
+}
+
+static bool heapLess(const distToImg& a, const distToImg& b) {
+    return a.distance < b.distance || (a.distance == b.distance && a.imgId < b.imgId);
+}
+
+SimilarityIndex::SimilarityIndex() {
+    mRoot = -1;
+}
+
+void SimilarityIndex::clear() {
+    mDesc.clear();
+    mNodes.clear();
+    mRoot = -1;
+}
+
+void SimilarityIndex::build(const std::vector<SrcImage>& imgs) {
+    clear();
+    mDesc.resize(imgs.size());
+    std::vector<int> ids(imgs.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    std::for_each(std::execution::par_unseq, ids.begin(), ids.end(), [&](int i) {
+        describe_image(imgs[i], mDesc[i]);
+    });
+
+    std::vector<std::pair<float, int>> items(imgs.size());
+    for (int i = 0; i < imgs.size(); i++)
+        items[i] = std::make_pair(0.0f, i);
+    mNodes.reserve(imgs.size());
+    mRoot = buildNode(items.data(), items.size());
+}
+
+int SimilarityIndex::buildNode(std::pair<float, int>* items, int count) {
+    if (count == 0)
+        return -1;
+
+    // vantage point is the item farthest from the parent's, a cheap spread heuristic
+    // that keeps the build deterministic
+    std::pair<float, int>* vp = std::max_element(items, items + count);
+    std::swap(*items, *vp);
+    int node = mNodes.size();
+    mNodes.push_back(Node{items[0].second, 0, -1, -1});
+
+    std::pair<float, int>* rest = items + 1;
+    int restCount = count - 1;
+    if (restCount == 0)
+        return node;
+    const ImageDescriptor& center = mDesc[items[0].second];
+    for (int i = 0; i < restCount; i++)
+        rest[i].first = desc_dist(center, mDesc[rest[i].second]);
+
+    int median = restCount / 2;
+    std::nth_element(rest, rest + median, rest + restCount);
+    float radius = rest[median].first;
+    int inside = buildNode(rest, median + 1);
+    int outside = buildNode(rest + median + 1, restCount - median - 1);
+    mNodes[node].radius = radius;
+    mNodes[node].inside = inside;
+    mNodes[node].outside = outside;
+    return node;
+}
+
+void SimilarityIndex::nearest(int id, int k, std::vector<distToImg>& out) const {
+    nearest(mDesc[id], k, out, id);
+}
+
+void SimilarityIndex::nearest(const ImageDescriptor& query, int k, std::vector<distToImg>& out, int exclude) const {
+    out.clear();
+    if (k <= 0 || mRoot < 0)
+        return;
+    out.reserve(k + 1);
+    float tau = INFINITY;
+    search(mRoot, query, k, exclude, out, tau);
+    std::sort_heap(out.begin(), out.end(), heapLess);
+}
+
+void SimilarityIndex::search(int node, const ImageDescriptor& query, int k, int exclude,
+                             std::vector<distToImg>& heap, float& tau) const {
+    if (node < 0)
+        return;
+    const Node& n = mNodes[node];
+    float d = desc_dist(query, mDesc[n.id]);
+    if (n.id != exclude && d <= tau) {
+        heap.push_back(distToImg{n.id, d});
+        std::push_heap(heap.begin(), heap.end(), heapLess);
+        if (heap.size() > k) {
+            std::pop_heap(heap.begin(), heap.end(), heapLess);
+            heap.pop_back();
+        }
+        if (heap.size() == k)
+            tau = heap.front().distance;
+    }
+
+    // nearer side first, the other only if the ball of radius tau crosses the boundary
+    if (d <= n.radius) {
+        if (d - tau <= n.radius)
+            search(n.inside, query, k, exclude, heap, tau);
+        if (d + tau >= n.radius)
+            search(n.outside, query, k, exclude, heap, tau);
+    } else {
+        if (d + tau >= n.radius)
+            search(n.outside, query, k, exclude, heap, tau);
+        if (d - tau <= n.radius)
+            search(n.inside, query, k, exclude, heap, tau);
+    }
+}
+
+static int color_cell(float c) {
+    return std::min(COLOR_CELLS - 1, std::max(0, (int)(c * COLOR_CELLS)));
+}
+
+ColorIndex::ColorIndex() {
+}
+
+void ColorIndex::build(const SimilarityIndex& index) {
+    int n = index.size();
+    mMeans.resize(n * 3);
+    mCellStart.assign(COLOR_CELLS * COLOR_CELLS * COLOR_CELLS + 1, 0);
+    mIds.resize(n);
+    std::vector<int> cells(n);
+    for (int i = 0; i < n; i++) {
+        const float* mean = index.descriptor(i).v;
+        for (int c = 0; c < 3; c++)
+            mMeans[i * 3 + c] = mean[c];
+        cells[i] = (color_cell(mean[0]) * COLOR_CELLS + color_cell(mean[1])) * COLOR_CELLS + color_cell(mean[2]);
+        mCellStart[cells[i] + 1]++;
+    }
+    for (int c = 0; c < COLOR_CELLS * COLOR_CELLS * COLOR_CELLS; c++)
+        mCellStart[c + 1] += mCellStart[c];
+    std::vector<int> fill(mCellStart.begin(), mCellStart.end() - 1);
+    for (int i = 0; i < n; i++)
+        mIds[fill[cells[i]]++] = i;
+}
+
+int ColorIndex::nearest(const float rgb[3], int count, int* out) const {
+    static thread_local std::vector<distToImg> found;
+    found.clear();
+    if (count <= 0 || mIds.empty())
+        return 0;
+
+    int q[3] = {color_cell(rgb[0]), color_cell(rgb[1]), color_cell(rgb[2])};
+    for (int r = 0; r < COLOR_CELLS; r++) {
+        int lo[3], hi[3];
+        for (int c = 0; c < 3; c++) {
+            lo[c] = std::max(0, q[c] - r);
+            hi[c] = std::min(COLOR_CELLS - 1, q[c] + r);
+        }
+        // cells at chebyshev distance r only, inner ones were visited already
+        for (int a = lo[0]; a <= hi[0]; a++) {
+            for (int b = lo[1]; b <= hi[1]; b++) {
+                for (int c = lo[2]; c <= hi[2]; c++) {
+                    if (std::max(std::max(abs(a - q[0]), abs(b - q[1])), abs(c - q[2])) != r)
+                        continue;
+                    int cell = (a * COLOR_CELLS + b) * COLOR_CELLS + c;
+                    for (int i = mCellStart[cell]; i < mCellStart[cell + 1]; i++) {
+                        const float* m = &mMeans[mIds[i] * 3];
+                        float d = (m[0] - rgb[0]) * (m[0] - rgb[0]) + (m[1] - rgb[1]) * (m[1] - rgb[1])
+                                + (m[2] - rgb[2]) * (m[2] - rgb[2]);
+                        found.push_back(distToImg{mIds[i], d});
+                    }
+                }
+            }
+        }
+        if (found.size() < count)
+            continue;
+        // anything in an outer shell is at least r cells away
+        std::nth_element(found.begin(), found.begin() + count - 1, found.end(), heapLess);
+        float bound = (float)r / COLOR_CELLS;
+        if (found[count - 1].distance <= bound * bound)
+            break;
+    }
+
+    int n = std::min((int)found.size(), count);
+    std::partial_sort(found.begin(), found.begin() + n, found.end(), heapLess);
+    for (int i = 0; i < n; i++)
+        out[i] = found[i].imgId;
+    return n;
+}
@@ -0,0 +1,80 @@
+#ifndef SIMILARITYINDEX_H
+#define SIMILARITYINDEX_H
+
+#include "utils.h"
+#include <utility>
+#include <vector>
+
+#define DESC_BINS 8 // histogram bins per channel
+#define DESC_GRID 4 // thumbnail is DESC_GRID x DESC_GRID cells
+#define DESC_SIZE (3 + 1 + 3 * DESC_BINS + 3 * DESC_GRID * DESC_GRID)
+
+// Mean colour, luma stddev, per channel histogram and a tiny thumbnail, all scaled
+// to roughly [0, 1] so euclidean distance weighs them alike.
+struct ImageDescriptor {
+    float v[DESC_SIZE];
+};
+
+struct distToImg {
+    int imgId;
+    float distance;
+};
+
+void describe_image(const SrcImage& img, ImageDescriptor& out);
+
+// Vantage-point tree over image descriptors. Descriptors are computed in parallel,
+// a k nearest neighbour query visits O(log N) nodes on typical libraries instead
+// of comparing against every image.
+class SimilarityIndex
+{
+    public:
+        SimilarityIndex();
+
+        void build(const std::vector<SrcImage>& imgs);
+        void clear();
+        int size() const { return mDesc.size(); }
+        const ImageDescriptor& descriptor(int id) const { return mDesc[id]; }
+
+        // k nearest images to image id, closest first, id itself excluded
+        void nearest(int id, int k, std::vector<distToImg>& out) const;
+        // k nearest images to any descriptor, exclude is skipped (-1 for none)
+        void nearest(const ImageDescriptor& query, int k, std::vector<distToImg>& out, int exclude = -1) const;
+
+    private:
+        struct Node {
+            int id;       // vantage point
+            float radius; // median distance, inside subtree is <= radius
+            int inside;   // node indexes, -1 when empty
+            int outside;
+        };
+
+        std::vector<ImageDescriptor> mDesc;
+        std::vector<Node> mNodes;
+        int mRoot;
+
+        int buildNode(std::pair<float, int>* items, int count); // (scratch distance, id)
+        void search(int node, const ImageDescriptor& query, int k, int exclude,
+                    std::vector<distToImg>& heap, float& tau) const;
+};
+
+#define COLOR_CELLS 16 // grid cells per channel
+
+// Images bucketed on a grid by mean colour, finds the images whose mean is closest
+// to a colour by searching cells in growing shells around it.
+class ColorIndex
+{
+    public:
+        ColorIndex();
+
+        // Mean colours are taken from the similarity index descriptors
+        void build(const SimilarityIndex& index);
+        // Up to count image IDs closest first, rgb in [0, 1] in pixel channel order
+        int nearest(const float rgb[3], int count, int* out) const;
+
+    private:
+        std::vector<float> mMeans;   // 3 per image
+        std::vector<int> mCellStart; // COLOR_CELLS^3 + 1 offsets into mIds
+        std::vector<int> mIds;
+};
+
+#endif // SIMILARITYINDEX_H
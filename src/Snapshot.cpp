@@ -0,0 +1,139 @@
+#include "Snapshot.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+SnapshotWriter::SnapshotWriter(const std::string& dir, const std::string& format, int queueDepth) {
+    mDir = dir;
+    mFormat = format;
+    mQueueDepth = std::max(queueDepth, 1);
+    mLastFitness = UINT64_MAX;
+    mLastWidth = 0;
+    mLastHeight = 0;
+    mBusy = false;
+    mStop = false;
+    mWritten = 0;
+    mDropped = 0;
+    std::error_code ec;
+    std::filesystem::create_directories(mDir, ec);
+    mThread = std::thread(&SnapshotWriter::run, this);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mCond.notify_all();
+    mThread.join();
+    for (int i = 0; i < mPool.size(); i++) {
+        delete mPool[i];
+    }
+}
+
+bool SnapshotWriter::submit(const SrcImage& target, const uint8_t* canvas, uint64_t generation, uint64_t fitness) {
+    // fitness of another resolution level is not comparable
+    if (fitness >= mLastFitness && target.width == mLastWidth && target.height == mLastHeight)
+        return false;
+    mLastFitness = fitness;
+    mLastWidth = target.width;
+    mLastHeight = target.height;
+
+    SnapshotFrame* frame;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mPool.empty()) {
+            frame = mPool.back();
+            mPool.pop_back();
+        } else {
+            frame = new SnapshotFrame();
+        }
+    }
+
+    // the only work done on the caller's thread
+    frame->width = target.width;
+    frame->height = target.height;
+    frame->pitch = target.pitch;
+    frame->generation = generation;
+    frame->fitness = fitness;
+    frame->pixels.resize((size_t)target.pitch * target.height);
+    simd_memcpy(frame->pixels.data(), canvas, frame->pixels.size());
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mQueue.size() >= mQueueDepth) {
+            mPool.push_back(mQueue.front());
+            mQueue.pop_front();
+            mDropped++;
+        }
+        mQueue.push_back(frame);
+    }
+    mCond.notify_all();
+    return true;
+}
+
+void SnapshotWriter::flush() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCond.wait(lock, [&] { return mQueue.empty() && !mBusy; });
+}
+
+uint64_t SnapshotWriter::written() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mWritten;
+}
+
+uint64_t SnapshotWriter::dropped() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mDropped;
+}
+
+void SnapshotWriter::run() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCond.wait(lock, [&] { return !mQueue.empty() || mStop; });
+        if (mQueue.empty())
+            break;
+
+        SnapshotFrame* frame = mQueue.front();
+        mQueue.pop_front();
+        mBusy = true;
+        lock.unlock();
+
+        bool ok = writeFile(*frame);
+
+        lock.lock();
+        mPool.push_back(frame);
+        mBusy = false;
+        if (ok)
+            mWritten++;
+        mCond.notify_all();
+    }
+}
+
+bool SnapshotWriter::writeFile(const SnapshotFrame& frame) {
+    char name[64];
+    snprintf(name, sizeof(name), "best_%010llu.", (unsigned long long)frame.generation);
+    std::string path = (std::filesystem::path(mDir) / (name + mFormat)).string();
+    // tmp keeps the extension, the encoder is picked by it
+    std::string tmp = (std::filesystem::path(mDir) / (std::string("tmp_") + name + mFormat)).string();
+
+    cv::Mat bgra(frame.height, frame.width, CV_8UC4, (void*)frame.pixels.data(), frame.pitch);
+    cv::Mat bgr;
+    cv::cvtColor(bgra, bgr, cv::COLOR_BGRA2BGR);
+    std::error_code ec;
+    if (cv::imwrite(tmp, bgr))
+        std::filesystem::rename(tmp, path, ec);
+    else
+        ec = std::make_error_code(std::errc::io_error);
+    if (ec) {
+        std::cout << "could not write snapshot " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "utils.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SnapshotFrame {
+    int width;
+    int height;
+    int pitch;
+    uint64_t generation;
+    uint64_t fitness;
+    std::vector<uint8_t> pixels; // BGRA rows of pitch bytes
+};
+
+// Dumps the best canvas as dir/best_<generation>.png or .ppm on a background thread.
+// submit() only copies the canvas into a pooled buffer, and only when fitness improved
+// since the last accepted frame at the same resolution; encoding and disk I/O happen on
+// the writer thread. At most queueDepth frames wait, a full queue drops its oldest frame.
+class SnapshotWriter
+{
+    public:
+        // format is "png" or "ppm"
+        SnapshotWriter(const std::string& dir, const std::string& format, int queueDepth);
+        virtual ~SnapshotWriter(); // writes what is queued
+
+        // canvas has the target's size and pitch, false when skipped (no improvement)
+        bool submit(const SrcImage& target, const uint8_t* canvas, uint64_t generation, uint64_t fitness);
+        // Blocks until every queued frame is on disk
+        void flush();
+
+        uint64_t written();
+        uint64_t dropped();
+
+    private:
+        void run();
+        bool writeFile(const SnapshotFrame& frame);
+
+        std::string mDir;
+        std::string mFormat;
+        int mQueueDepth;
+        uint64_t mLastFitness;
+        int mLastWidth;
+        int mLastHeight;
+        std::thread mThread;
+        std::mutex mMutex;
+        std::condition_variable mCond;
+        std::deque<SnapshotFrame*> mQueue;
+        std::vector<SnapshotFrame*> mPool;
+        bool mBusy;
+        bool mStop;
+        uint64_t mWritten;
+        uint64_t mDropped;
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,226 @@
+#include "SpriteCache.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+static const double TWO_PI = 6.283185307179586;
+
+SpriteCache::SpriteCache(size_t budgetBytes, float angleStep, float scaleStep)
+        : mBudget(budgetBytes), mAngleStep(angleStep), mScaleStep(scaleStep), mBytes(0) {
+    int shards = 1;
+    while (shards < SPRITE_SHARDS && budgetBytes / (shards * 2) >= SPRITE_SHARD_MIN_BYTES)
+        shards *= 2;
+    mShardShift = 64 - __builtin_ctz(shards);
+    for (int i = 0; i < SPRITE_SHARDS; i++) {
+        mShards[i].hits = 0;
+        mShards[i].misses = 0;
+    }
+}
+
+SpriteCache::~SpriteCache() {
+
+}
+
+void SpriteCache::quantize(float angle, float scale, int* pAngleQ, int* pScaleQ, float* pAngle, float* pScale) {
+    int angleLevels = std::max(1, (int)lround(TWO_PI / mAngleStep));
+    double a = fmod((double)angle, TWO_PI);
+    if (a < 0)
+        a += TWO_PI;
+    *pAngleQ = (int)lround(a / TWO_PI * angleLevels) % angleLevels;
+    *pAngle = *pAngleQ * TWO_PI / angleLevels;
+
+    double logStep = log1p(mScaleStep);
+    *pScaleQ = (int)lround(log(scale) / logStep);
+    *pScale = exp(*pScaleQ * logStep);
+}
+
+// Sprite size and pivot for rotating img around its (0, 0) corner, same convention as RotateDrawClipExt2
+void SpriteCache::layout(const SrcImage& img, float angle, float scale,
+                         int* pWidth, int* pHeight, int* pPivotX, int* pPivotY) {
+    float sinAngle = sin(-angle);
+    float cosAngle = cos(-angle);
+
+    float xs[4] = {0, cosAngle * img.width * scale,
+                   cosAngle * img.width * scale - sinAngle * img.height * scale,
+                   -sinAngle * img.height * scale};
+    float ys[4] = {0, sinAngle * img.width * scale,
+                   sinAngle * img.width * scale + cosAngle * img.height * scale,
+                   cosAngle * img.height * scale};
+
+    float minx = xs[0], maxx = xs[0], miny = ys[0], maxy = ys[0];
+    for (int i = 1; i < 4; i++) {
+        minx = std::min(minx, xs[i]);
+        maxx = std::max(maxx, xs[i]);
+        miny = std::min(miny, ys[i]);
+        maxy = std::max(maxy, ys[i]);
+    }
+
+    *pPivotX = (int)ceil(-minx) + 1;
+    *pPivotY = (int)ceil(-miny) + 1;
+    *pWidth = (int)ceil(maxx) + *pPivotX + 2;
+    *pHeight = (int)ceil(maxy) + *pPivotY + 2;
+}
+
+SpriteCache::SpritePtr SpriteCache::render(const SrcImage& img, float angle, float scale) {
+    std::shared_ptr<CachedSprite> sprite = std::make_shared<CachedSprite>();
+    layout(img, angle, scale, &sprite->width, &sprite->height, &sprite->pivotX, &sprite->pivotY);
+
+    int w = sprite->width;
+    int h = sprite->height;
+    int words = (w + 63) >> 6;
+    std::vector<uint64_t> coverage((size_t)words * h, 0);
+
+    sprite->pixels.assign((size_t)w * h, 0);
+    RotateDrawClipRegionCovered(sprite->pixels.data(), w, h, w * sizeof(RotatePixel_t),
+                                (RotatePixel_t*)img.data, img.width, img.height, img.pitch,
+                                sprite->pivotX, sprite->pivotY, 0, 0,
+                                angle, scale,
+                                0, 0, w - 1, h - 1,
+                                coverage.data(), words);
+
+    // rows of a rotated rectangle are single spans
+    sprite->spanStart.assign(h, 0);
+    sprite->spanEnd.assign(h, 0);
+    for (int y = 0; y < h; y++) {
+        const uint64_t* row = &coverage[(size_t)y * words];
+        int first = -1;
+        int last = -1;
+        for (int k = 0; k < words; k++) {
+            if (row[k] == 0)
+                continue;
+            if (first < 0)
+                first = k * 64 + __builtin_ctzll(row[k]);
+            last = k * 64 + 63 - __builtin_clzll(row[k]);
+        }
+        if (first >= 0) {
+            sprite->spanStart[y] = first;
+            sprite->spanEnd[y] = last + 1;
+        }
+    }
+
+    return sprite;
+}
+
+SpriteCache::SpritePtr SpriteCache::get(int imgID, const SrcImage& img, float angle, float scale) {
+    int angleQ, scaleQ;
+    float qAngle, qScale;
+    quantize(angle, scale, &angleQ, &scaleQ, &qAngle, &qScale);
+    uint64_t key = ((uint64_t)(uint32_t)imgID << 32) | ((uint64_t)(uint16_t)angleQ << 16)
+                    | (uint16_t)(scaleQ + 32768);
+    // top bits of a multiplicative hash, neighbouring angles of one image land apart
+    uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+    Shard& shard = mShards[mShardShift == 64 ? 0 : hash >> mShardShift];
+
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            shard.hits.fetch_add(1, std::memory_order_relaxed);
+            return it->second->sprite;
+        }
+    }
+
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+    SpritePtr sprite = render(img, qAngle, qScale);
+    size_t bytes = sizeof(CachedSprite) + sprite->pixels.size() * sizeof(RotatePixel_t)
+                    + sprite->spanStart.size() * 2 * sizeof(int);
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        // another thread rendered it meanwhile
+        return it->second->sprite;
+    }
+    shard.lru.push_front(Entry{key, sprite, bytes});
+    shard.index[key] = shard.lru.begin();
+    mBytes += bytes;
+
+    while (mBytes > mBudget && shard.lru.size() > 1) {
+        mBytes -= shard.lru.back().bytes;
+        shard.index.erase(shard.lru.back().key);
+        shard.lru.pop_back();
+    }
+
+    return sprite;
+}
+
+bool SpriteCache::bounds(int dstW, int dstH, const SrcImage& img,
+                         float ox, float oy, float angle, float scale,
+                         int* pMinX, int* pMinY, int* pMaxX, int* pMaxY) {
+    int angleQ, scaleQ;
+    float qAngle, qScale;
+    quantize(angle, scale, &angleQ, &scaleQ, &qAngle, &qScale);
+
+    int w, h, pivotX, pivotY;
+    layout(img, qAngle, qScale, &w, &h, &pivotX, &pivotY);
+
+    int baseX = (int)floorf(ox) - pivotX;
+    int baseY = (int)floorf(oy) - pivotY;
+    *pMinX = std::max(baseX, 0);
+    *pMinY = std::max(baseY, 0);
+    *pMaxX = std::min(baseX + w - 1, dstW - 1);
+    *pMaxY = std::min(baseY + h - 1, dstH - 1);
+
+    return *pMinX <= *pMaxX && *pMinY <= *pMaxY;
+}
+
+void SpriteCache::draw(RotatePixel_t* pDstBase, int dstW, int dstH, int dstDelta,
+                       int imgID, const SrcImage& img,
+                       float ox, float oy, float angle, float scale,
+                       int clipMinX, int clipMinY, int clipMaxX, int clipMaxY) {
+    SpritePtr sprite = get(imgID, img, angle, scale);
+
+    int baseX = (int)floorf(ox) - sprite->pivotX;
+    int baseY = (int)floorf(oy) - sprite->pivotY;
+
+    clipMinX = std::max(clipMinX, 0);
+    clipMinY = std::max(clipMinY, 0);
+    clipMaxX = std::min(clipMaxX, dstW - 1);
+    clipMaxY = std::min(clipMaxY, dstH - 1);
+
+    int y0 = std::max(clipMinY - baseY, 0);
+    int y1 = std::min(clipMaxY - baseY + 1, sprite->height);
+
+    for (int y = y0; y < y1; y++) {
+        int xs = std::max(sprite->spanStart[y] + baseX, clipMinX);
+        int xe = std::min(sprite->spanEnd[y] + baseX, clipMaxX + 1);
+        if (xs >= xe)
+            continue;
+
+        RotatePixel_t* dstRow = (RotatePixel_t*)((uint8_t*)pDstBase + (size_t)(baseY + y) * dstDelta);
+        memcpy(dstRow + xs, &sprite->pixels[(size_t)y * sprite->width + (xs - baseX)],
+               (xe - xs) * sizeof(RotatePixel_t));
+    }
+}
+
+void SpriteCache::clear() {
+    for (int i = 0; i < SPRITE_SHARDS; i++) {
+        std::lock_guard<std::mutex> guard(mShards[i].lock);
+        for (auto it = mShards[i].lru.begin(); it != mShards[i].lru.end(); ++it) {
+            mBytes -= it->bytes;
+        }
+        mShards[i].lru.clear();
+        mShards[i].index.clear();
+    }
+}
+
+size_t SpriteCache::bytesUsed() {
+    return mBytes;
+}
+
+uint64_t SpriteCache::hits() const {
+    uint64_t sum = 0;
+    for (int i = 0; i < SPRITE_SHARDS; i++) {
+        sum += mShards[i].hits.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+uint64_t SpriteCache::misses() const {
+    uint64_t sum = 0;
+    for (int i = 0; i < SPRITE_SHARDS; i++) {
+        sum += mShards[i].misses.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
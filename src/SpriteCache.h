@@ -0,0 +1,85 @@
+#ifndef SPRITECACHE_H
+#define SPRITECACHE_H
+
+#include "utils.h"
+#include "rotate.h"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#define SPRITE_SHARDS 64
+#define SPRITE_SHARD_MIN_BYTES (1 << 20) // budget per shard below which fewer shards are used
+
+// Source image pre-rotated and pre-scaled at quantized angle/scale.
+struct CachedSprite {
+    int width;
+    int height;
+    int pivotX; // where source (0, 0) lands inside the sprite
+    int pivotY;
+    std::vector<RotatePixel_t> pixels;
+    std::vector<int> spanStart; // per row, covered pixels are [spanStart, spanEnd)
+    std::vector<int> spanEnd;
+};
+
+// LRU cache of pre-transformed sprites keyed by (imgID, quantized angle, quantized scale).
+// Drawing a cached sprite is a clipped per-row copy, at the price of snapping angle/scale
+// to the quantization grid and position to whole pixels.
+// Every layer draw looks a sprite up from the parallel step, so keys are spread over up
+// to SPRITE_SHARDS shards, each with its own lock and LRU list. The budget is shared: a
+// shard that inserts past it evicts from its own tail, an approximate global LRU. Small
+// budgets get fewer shards so each still holds enough sprites for LRU to matter.
+class SpriteCache
+{
+    public:
+        // angleStep in radians, scaleStep is relative (0.02 = 2% between levels)
+        SpriteCache(size_t budgetBytes, float angleStep, float scaleStep);
+        virtual ~SpriteCache();
+
+        // Same pivot convention as RotateDrawClip with source rotation center (0, 0)
+        void draw(RotatePixel_t* pDstBase, int dstW, int dstH, int dstDelta,
+                  int imgID, const SrcImage& img,
+                  float ox, float oy, float angle, float scale,
+                  int clipMinX, int clipMinY, int clipMaxX, int clipMaxY);
+        // Destination box draw() may touch, inclusive and clipped to destination
+        bool bounds(int dstW, int dstH, const SrcImage& img,
+                    float ox, float oy, float angle, float scale,
+                    int* pMinX, int* pMinY, int* pMaxX, int* pMaxY);
+        void clear();
+
+        uint64_t hits() const;
+        uint64_t misses() const;
+        size_t bytesUsed();
+
+    private:
+        typedef std::shared_ptr<const CachedSprite> SpritePtr;
+        struct Entry {
+            uint64_t key;
+            SpritePtr sprite;
+            size_t bytes;
+        };
+        struct alignas(64) Shard {
+            std::mutex lock; // guards lru and index
+            std::list<Entry> lru; // front is most recently used
+            std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+            std::atomic<uint64_t> hits;
+            std::atomic<uint64_t> misses;
+        };
+
+        size_t mBudget;
+        float mAngleStep;
+        float mScaleStep;
+        Shard mShards[SPRITE_SHARDS];
+        int mShardShift; // shard of a key is the top bits of its hash
+        std::atomic<size_t> mBytes;
+
+        void quantize(float angle, float scale, int* pAngleQ, int* pScaleQ, float* pAngle, float* pScale);
+        void layout(const SrcImage& img, float angle, float scale,
+                    int* pWidth, int* pHeight, int* pPivotX, int* pPivotY);
+        SpritePtr get(int imgID, const SrcImage& img, float angle, float scale);
+        SpritePtr render(const SrcImage& img, float angle, float scale);
+};
+
+#endif // SPRITECACHE_H
@@ -14,10 +14,14 @@ void Timer::start() {
     startT = std::chrono::steady_clock::now();
 }
 
-int Timer::get() {
+int64_t Timer::get() {
     std::chrono::time_point<std::chrono::steady_clock> endT = std::chrono::steady_clock::now();
 
     std::chrono::microseconds diff = std::chrono::duration_cast<std::chrono::microseconds>(endT - startT);
 
     return diff.count();
 }
+
+int64_t Timer::getNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startT).count();
+}
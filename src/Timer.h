@@ -1,6 +1,7 @@
 #ifndef TIMER_H
 #define TIMER_H
 #include <chrono>
+#include <stdint.h>
 
 class Timer
 {
@@ -8,7 +9,8 @@ class Timer
         Timer();
         virtual ~Timer();
         void start();
-        int get();
+        int64_t get(); // microseconds
+        int64_t getNanos();
 
     protected:
 
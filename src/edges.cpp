@@ -0,0 +1,165 @@
+#include "edges.h"
+#include "metrics.h"
+#include <immintrin.h>
+#include <string.h>
+#include <algorithm>
+
+// Columns per strip, 3 luma rows of a strip stay in L1
+static const int EDGE_TILE_W = 512;
+// Vector loops may read this far past the last needed luma value
+static const int EDGE_TILE_PAD = 64;
+
+typedef void (*LumaRow_t)(const uint8_t* rgba, int count, uint16_t* out);
+typedef void (*GradRow_t)(const uint16_t* r0, const uint16_t* r1, const uint16_t* r2, int count, uint8_t* out);
+
+/* Scalar */
+
+static void luma_row_scalar(const uint8_t* rgba, int count, uint16_t* out) {
+    for (int i = 0; i < count; i++) {
+        out[i] = (rgba[i * 4 + 0] + rgba[i * 4 + 1] + rgba[i * 4 + 2]) / 3;
+    }
+}
+
+// r0, r1, r2 point at luma of the column left of the first output
+static void grad_row_scalar(const uint16_t* r0, const uint16_t* r1, const uint16_t* r2, int count, uint8_t* out) {
+    for (int i = 0; i < count; i++) {
+        int gx = (r0[i + 2] + 2 * r1[i + 2] + r2[i + 2]) - (r0[i] + 2 * r1[i] + r2[i]);
+        int gy = (r0[i] + 2 * r0[i + 1] + r0[i + 2]) - (r2[i] + 2 * r2[i + 1] + r2[i + 2]);
+        int g = std::abs(gx) + std::abs(gy);
+        out[i] = g > 255 ? 255 : g;
+    }
+}
+
+/* AVX2 */
+
+__attribute__((target("avx2")))
+static void luma_row_avx2(const uint8_t* rgba, int count, uint16_t* out) {
+    const __m256i weights = _mm256_set1_epi32(0x00010101); // b, g, r, not alpha
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i div3 = _mm256_set1_epi32(43691); // x / 3 == (x * 43691) >> 17 for x < 98304
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i*)(rgba + i * 4));
+        __m256i sum = _mm256_madd_epi16(_mm256_maddubs_epi16(px, weights), ones);
+        __m256i luma = _mm256_srli_epi32(_mm256_mullo_epi32(sum, div3), 17);
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(luma), _mm256_extracti128_si256(luma, 1));
+        _mm_storeu_si128((__m128i*)(out + i), packed);
+    }
+    luma_row_scalar(rgba + i * 4, count - i, out + i);
+}
+
+__attribute__((target("avx2")))
+static void grad_row_avx2(const uint16_t* r0, const uint16_t* r1, const uint16_t* r2, int count, uint8_t* out) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i p1 = _mm256_loadu_si256((const __m256i*)(r0 + i));
+        __m256i p2 = _mm256_loadu_si256((const __m256i*)(r0 + i + 1));
+        __m256i p3 = _mm256_loadu_si256((const __m256i*)(r0 + i + 2));
+        __m256i p4 = _mm256_loadu_si256((const __m256i*)(r1 + i));
+        __m256i p6 = _mm256_loadu_si256((const __m256i*)(r1 + i + 2));
+        __m256i p7 = _mm256_loadu_si256((const __m256i*)(r2 + i));
+        __m256i p8 = _mm256_loadu_si256((const __m256i*)(r2 + i + 1));
+        __m256i p9 = _mm256_loadu_si256((const __m256i*)(r2 + i + 2));
+
+        __m256i gx = _mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(p3, p9), _mm256_add_epi16(p6, p6)),
+                                      _mm256_add_epi16(_mm256_add_epi16(p1, p7), _mm256_add_epi16(p4, p4)));
+        __m256i gy = _mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(p1, p3), _mm256_add_epi16(p2, p2)),
+                                      _mm256_add_epi16(_mm256_add_epi16(p7, p9), _mm256_add_epi16(p8, p8)));
+        __m256i g = _mm256_add_epi16(_mm256_abs_epi16(gx), _mm256_abs_epi16(gy));
+
+        __m128i packed = _mm_packus_epi16(_mm256_castsi256_si128(g), _mm256_extracti128_si256(g, 1));
+        _mm_storeu_si128((__m128i*)(out + i), packed);
+    }
+    grad_row_scalar(r0 + i, r1 + i, r2 + i, count - i, out + i);
+}
+
+/* AVX-512 */
+
+__attribute__((target("avx512f,avx512bw")))
+static void luma_row_avx512(const uint8_t* rgba, int count, uint16_t* out) {
+    const __m512i weights = _mm512_set1_epi32(0x00010101);
+    const __m512i ones = _mm512_set1_epi16(1);
+    const __m512i div3 = _mm512_set1_epi32(43691);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i px = _mm512_loadu_si512(rgba + i * 4);
+        __m512i sum = _mm512_madd_epi16(_mm512_maddubs_epi16(px, weights), ones);
+        __m512i luma = _mm512_srli_epi32(_mm512_mullo_epi32(sum, div3), 17);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm512_cvtepi32_epi16(luma));
+    }
+    luma_row_scalar(rgba + i * 4, count - i, out + i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void grad_row_avx512(const uint16_t* r0, const uint16_t* r1, const uint16_t* r2, int count, uint8_t* out) {
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m512i p1 = _mm512_loadu_si512(r0 + i);
+        __m512i p2 = _mm512_loadu_si512(r0 + i + 1);
+        __m512i p3 = _mm512_loadu_si512(r0 + i + 2);
+        __m512i p4 = _mm512_loadu_si512(r1 + i);
+        __m512i p6 = _mm512_loadu_si512(r1 + i + 2);
+        __m512i p7 = _mm512_loadu_si512(r2 + i);
+        __m512i p8 = _mm512_loadu_si512(r2 + i + 1);
+        __m512i p9 = _mm512_loadu_si512(r2 + i + 2);
+
+        __m512i gx = _mm512_sub_epi16(_mm512_add_epi16(_mm512_add_epi16(p3, p9), _mm512_add_epi16(p6, p6)),
+                                      _mm512_add_epi16(_mm512_add_epi16(p1, p7), _mm512_add_epi16(p4, p4)));
+        __m512i gy = _mm512_sub_epi16(_mm512_add_epi16(_mm512_add_epi16(p1, p3), _mm512_add_epi16(p2, p2)),
+                                      _mm512_add_epi16(_mm512_add_epi16(p7, p9), _mm512_add_epi16(p8, p8)));
+        __m512i g = _mm512_add_epi16(_mm512_abs_epi16(gx), _mm512_abs_epi16(gy));
+
+        _mm256_storeu_si256((__m256i*)(out + i), _mm512_cvtusepi16_epi8(g));
+    }
+    grad_row_scalar(r0 + i, r1 + i, r2 + i, count - i, out + i);
+}
+
+void sobel_fused_region(const uint8_t* rgba, int width, int height, int pitch,
+                        int minx, int miny, int maxx, int maxy,
+                        uint8_t* out, int outPitch) {
+    minx = std::max(minx, 1);
+    miny = std::max(miny, 1);
+    maxx = std::min(maxx, width - 2);
+    maxy = std::min(maxy, height - 2);
+    if (minx > maxx || miny > maxy)
+        return;
+
+    LumaRow_t luma = luma_row_scalar;
+    GradRow_t grad = grad_row_scalar;
+    MetricIsa isa = metric_isa();
+    if (isa == METRIC_ISA_AVX512) {
+        luma = luma_row_avx512;
+        grad = grad_row_avx512;
+    } else if (isa == METRIC_ISA_AVX2) {
+        luma = luma_row_avx2;
+        grad = grad_row_avx2;
+    }
+
+    uint16_t ring[3][EDGE_TILE_W + 2 + EDGE_TILE_PAD];
+
+    for (int x0 = minx; x0 <= maxx; x0 += EDGE_TILE_W) {
+        int n = std::min(EDGE_TILE_W, maxx - x0 + 1);
+        const uint8_t* col = rgba + (x0 - 1) * 4;
+
+        luma(col + (size_t)(miny - 1) * pitch, n + 2, ring[0]);
+        luma(col + (size_t)miny * pitch, n + 2, ring[1]);
+
+        for (int y = miny; y <= maxy; y++) {
+            int k = y - miny;
+            luma(col + (size_t)(y + 1) * pitch, n + 2, ring[(k + 2) % 3]);
+            grad(ring[k % 3], ring[(k + 1) % 3], ring[(k + 2) % 3], n, out + (size_t)y * outPitch + x0);
+        }
+    }
+}
+
+void sobel_fused(const uint8_t* rgba, int width, int height, int pitch, uint8_t* out, int outPitch) {
+    for (int y = 0; y < height; y++) {
+        if (y == 0 || y == height - 1) {
+            memset(out + (size_t)y * outPitch, 0, width);
+        } else {
+            out[(size_t)y * outPitch] = 0;
+            out[(size_t)y * outPitch + width - 1] = 0;
+        }
+    }
+    sobel_fused_region(rgba, width, height, pitch, 1, 1, width - 2, height - 2, out, outPitch);
+}
@@ -0,0 +1,19 @@
+#ifndef EDGES_H
+#define EDGES_H
+#include <stdint.h>
+
+/* Fused greyscale + Sobel edge magnitude.
+   Luma is (b + g + r) / 3 of 32-bit pixels, edge is |Gx| + |Gy| saturated to 255.
+   Works in column strips with rolling luma rows on the stack, so it never allocates.
+   Kernel variant follows metric_isa(). */
+
+// Edges for all pixels, border pixels are set to 0. out is width x height with outPitch bytes per row.
+void sobel_fused(const uint8_t* rgba, int width, int height, int pitch, uint8_t* out, int outPitch);
+
+// Edges only for pixels inside [minx..maxx] x [miny..maxy] (inclusive), clipped to image interior.
+// Nothing outside of that is written.
+void sobel_fused_region(const uint8_t* rgba, int width, int height, int pitch,
+                        int minx, int miny, int maxx, int maxy,
+                        uint8_t* out, int outPitch);
+
+#endif // EDGES_H
@@ -0,0 +1,246 @@
+#include "metrics.h"
+#include <immintrin.h>
+#include <string.h>
+#include <algorithm>
+
+/* Scalar */
+
+uint64_t compute_sad_naive(const uint8_t* image, const uint8_t* target, size_t num_bytes) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < num_bytes; i++) {
+        if (image[i] > target[i])
+            sum += image[i] - target[i];
+        else
+            sum += target[i] - image[i];
+    }
+    return sum;
+}
+
+uint64_t compute_sse_naive(const uint8_t* image, const uint8_t* target, size_t num_bytes) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < num_bytes; i++) {
+        int dif = image[i] - target[i];
+        sum += dif * dif;
+    }
+    return sum;
+}
+
+static void memcpy_scalar(uint8_t* dst, const uint8_t* src, size_t num_bytes) {
+    memcpy(dst, src, num_bytes);
+}
+
+// 32-bit squared sums are flushed to 64-bit every SSE_BLOCK_ITERS iterations,
+// each lane gains at most 2 * 2 * 255^2 per iteration so it can not overflow
+static const size_t SSE_BLOCK_ITERS = 8192;
+
+/* SSE4.1 */
+
+__attribute__((target("sse4.1")))
+static uint64_t sad_sse41(const uint8_t* image, const uint8_t* target, size_t num_bytes) {
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= num_bytes; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(image + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(target + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(a, b));
+    }
+    uint64_t sum = _mm_cvtsi128_si64(acc) + _mm_extract_epi64(acc, 1);
+    return sum + compute_sad_naive(image + i, target + i, num_bytes - i);
+}
+
+__attribute__((target("sse4.1")))
+static uint64_t sse_sse41(const uint8_t* image, const uint8_t* target, size_t num_bytes) {
+    __m128i acc64 = _mm_setzero_si128();
+    size_t full = num_bytes & ~(size_t)15;
+    size_t i = 0;
+    while (i < full) {
+        __m128i acc32 = _mm_setzero_si128();
+        size_t blockEnd = std::min(full, i + 16 * SSE_BLOCK_ITERS);
+        for (; i < blockEnd; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(image + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(target + i));
+            __m128i dlo = _mm_sub_epi16(_mm_cvtepu8_epi16(a), _mm_cvtepu8_epi16(b));
+            __m128i dhi = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(a, 8)),
+                                        _mm_cvtepu8_epi16(_mm_srli_si128(b, 8)));
+            acc32 = _mm_add_epi32(acc32, _mm_madd_epi16(dlo, dlo));
+            acc32 = _mm_add_epi32(acc32, _mm_madd_epi16(dhi, dhi));
+        }
+        acc64 = _mm_add_epi64(acc64, _mm_cvtepu32_epi64(acc32));
+        acc64 = _mm_add_epi64(acc64, _mm_cvtepu32_epi64(_mm_srli_si128(acc32, 8)));
+    }
+    uint64_t sum = _mm_cvtsi128_si64(acc64) + _mm_extract_epi64(acc64, 1);
+    return sum + compute_sse_naive(image + i, target + i, num_bytes - i);
+}
+
+/* AVX2 */
+
+__attribute__((target("avx2")))
+static uint64_t reduce_epi64_avx2(__m256i v) {
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+}
+
+__attribute__((target("avx2")))
+static uint64_t sad_avx2(const uint8_t* image, const uint8_t* target, size_t num_bytes) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= num_bytes; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(image + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(target + i));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(a, b));
+    }
+    return reduce_epi64_avx2(acc) + compute_sad_naive(image + i, target + i, num_bytes - i);
+}
+
+__attribute__((target("avx2")))
+static uint64_t sse_avx2(const uint8_t* image, const uint8_t* target, size_t num_bytes) {
+    __m256i acc64 = _mm256_setzero_si256();
+    size_t full = num_bytes & ~(size_t)31;
+    size_t i = 0;
+    while (i < full) {
+        __m256i acc32 = _mm256_setzero_si256();
+        size_t blockEnd = std::min(full, i + 32 * SSE_BLOCK_ITERS);
+        for (; i < blockEnd; i += 32) {
+            __m128i alo = _mm_loadu_si128((const __m128i*)(image + i));
+            __m128i ahi = _mm_loadu_si128((const __m128i*)(image + i + 16));
+            __m128i blo = _mm_loadu_si128((const __m128i*)(target + i));
+            __m128i bhi = _mm_loadu_si128((const __m128i*)(target + i + 16));
+            __m256i dlo = _mm256_sub_epi16(_mm256_cvtepu8_epi16(alo), _mm256_cvtepu8_epi16(blo));
+            __m256i dhi = _mm256_sub_epi16(_mm256_cvtepu8_epi16(ahi), _mm256_cvtepu8_epi16(bhi));
+            acc32 = _mm256_add_epi32(acc32, _mm256_madd_epi16(dlo, dlo));
+            acc32 = _mm256_add_epi32(acc32, _mm256_madd_epi16(dhi, dhi));
+        }
+        acc64 = _mm256_add_epi64(acc64, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(acc32)));
+        acc64 = _mm256_add_epi64(acc64, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(acc32, 1)));
+    }
+    return reduce_epi64_avx2(acc64) + compute_sse_naive(image + i, target + i, num_bytes - i);
+}
+
+/* AVX-512 */
+
+__attribute__((target("avx512f,avx512bw")))
+static uint64_t sad_avx512(const uint8_t* image, const uint8_t* target, size_t num_bytes) {
+    __m512i acc = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 64 <= num_bytes; i += 64) {
+        __m512i a = _mm512_loadu_si512(image + i);
+        __m512i b = _mm512_loadu_si512(target + i);
+        acc = _mm512_add_epi64(acc, _mm512_sad_epu8(a, b));
+    }
+    if (i < num_bytes) {
+        __mmask64 m = ~(uint64_t)0 >> (64 - (num_bytes - i));
+        __m512i a = _mm512_maskz_loadu_epi8(m, image + i);
+        __m512i b = _mm512_maskz_loadu_epi8(m, target + i);
+        acc = _mm512_add_epi64(acc, _mm512_sad_epu8(a, b));
+    }
+    return _mm512_reduce_add_epi64(acc);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static uint64_t sse_avx512(const uint8_t* image, const uint8_t* target, size_t num_bytes) {
+    __m512i acc64 = _mm512_setzero_si512();
+    size_t full = num_bytes & ~(size_t)63;
+    size_t i = 0;
+    while (i < full) {
+        __m512i acc32 = _mm512_setzero_si512();
+        size_t blockEnd = std::min(full, i + 64 * SSE_BLOCK_ITERS);
+        for (; i < blockEnd; i += 64) {
+            __m256i alo = _mm256_loadu_si256((const __m256i*)(image + i));
+            __m256i ahi = _mm256_loadu_si256((const __m256i*)(image + i + 32));
+            __m256i blo = _mm256_loadu_si256((const __m256i*)(target + i));
+            __m256i bhi = _mm256_loadu_si256((const __m256i*)(target + i + 32));
+            __m512i dlo = _mm512_sub_epi16(_mm512_cvtepu8_epi16(alo), _mm512_cvtepu8_epi16(blo));
+            __m512i dhi = _mm512_sub_epi16(_mm512_cvtepu8_epi16(ahi), _mm512_cvtepu8_epi16(bhi));
+            acc32 = _mm512_add_epi32(acc32, _mm512_madd_epi16(dlo, dlo));
+            acc32 = _mm512_add_epi32(acc32, _mm512_madd_epi16(dhi, dhi));
+        }
+        acc64 = _mm512_add_epi64(acc64, _mm512_cvtepu32_epi64(_mm512_castsi512_si256(acc32)));
+        acc64 = _mm512_add_epi64(acc64, _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(acc32, 1)));
+    }
+    return _mm512_reduce_add_epi64(acc64) + compute_sse_naive(image + i, target + i, num_bytes - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void memcpy_avx512(uint8_t* dst, const uint8_t* src, size_t num_bytes) {
+    // should i convert this to uint32_t ?
+    // I think benchmarks did not show significant improvement
+    size_t i = 0;
+    for (; i + 64 <= num_bytes; i += 64) {
+        _mm512_storeu_si512(dst + i, _mm512_loadu_si512(src + i));
+    }
+    if (i < num_bytes) {
+        __mmask64 m = ~(uint64_t)0 >> (64 - (num_bytes - i));
+        _mm512_mask_storeu_epi8(dst + i, m, _mm512_maskz_loadu_epi8(m, src + i));
+    }
+}
+
+/* Dispatch */
+
+typedef uint64_t (*MetricKernel_t)(const uint8_t* image, const uint8_t* target, size_t num_bytes);
+typedef void (*CopyKernel_t)(uint8_t* dst, const uint8_t* src, size_t num_bytes);
+
+struct MetricKernels {
+    MetricIsa isa;
+    MetricKernel_t sad;
+    MetricKernel_t sse;
+    CopyKernel_t copy;
+};
+
+static MetricIsa detect_isa() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return METRIC_ISA_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return METRIC_ISA_AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return METRIC_ISA_SSE41;
+    return METRIC_ISA_SCALAR;
+}
+
+static MetricKernels kernels_for(MetricIsa isa) {
+    switch (isa) {
+        case METRIC_ISA_AVX512:
+            return MetricKernels{isa, sad_avx512, sse_avx512, memcpy_avx512};
+        case METRIC_ISA_AVX2:
+            return MetricKernels{isa, sad_avx2, sse_avx2, memcpy_scalar};
+        case METRIC_ISA_SSE41:
+            return MetricKernels{isa, sad_sse41, sse_sse41, memcpy_scalar};
+        default:
+            return MetricKernels{METRIC_ISA_SCALAR, compute_sad_naive, compute_sse_naive, memcpy_scalar};
+    }
+}
+
+static MetricKernels& active_kernels() {
+    static MetricKernels kernels = kernels_for(detect_isa());
+    return kernels;
+}
+
+uint64_t compute_sad(const uint8_t* image, const uint8_t* target, size_t num_bytes) {
+    return active_kernels().sad(image, target, num_bytes);
+}
+
+uint64_t compute_sse(const uint8_t* image, const uint8_t* target, size_t num_bytes) {
+    return active_kernels().sse(image, target, num_bytes);
+}
+
+void simd_memcpy(uint8_t* dst, const uint8_t* src, size_t num_bytes) {
+    active_kernels().copy(dst, src, num_bytes);
+}
+
+MetricIsa metric_isa() {
+    return active_kernels().isa;
+}
+
+const char* metric_isa_name(MetricIsa isa) {
+    switch (isa) {
+        case METRIC_ISA_AVX512: return "avx512";
+        case METRIC_ISA_AVX2:   return "avx2";
+        case METRIC_ISA_SSE41:  return "sse4.1";
+        default:                return "scalar";
+    }
+}
+
+// Not thread safe, call before evolution starts
+void metric_force_isa(MetricIsa isa) {
+    active_kernels() = kernels_for(std::min(isa, detect_isa()));
+}
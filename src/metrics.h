@@ -0,0 +1,28 @@
+#ifndef METRICS_H
+#define METRICS_H
+#include <stdint.h>
+#include <stddef.h>
+
+/* Pixel metric kernels.
+   Every kernel has scalar, SSE4.1, AVX2 and AVX-512 variant, best supported one
+   is picked once (CPUID) on first use, so the same binary runs on any x86-64 host. */
+
+enum MetricIsa {
+    METRIC_ISA_SCALAR,
+    METRIC_ISA_SSE41,
+    METRIC_ISA_AVX2,
+    METRIC_ISA_AVX512
+};
+
+uint64_t compute_sad(const uint8_t* image, const uint8_t* target, size_t num_bytes);
+uint64_t compute_sse(const uint8_t* image, const uint8_t* target, size_t num_bytes);
+uint64_t compute_sad_naive(const uint8_t* image, const uint8_t* target, size_t num_bytes);
+uint64_t compute_sse_naive(const uint8_t* image, const uint8_t* target, size_t num_bytes);
+void simd_memcpy(uint8_t* dst, const uint8_t* src, size_t num_bytes);
+
+MetricIsa metric_isa();
+const char* metric_isa_name(MetricIsa isa);
+// For benchmarking, isa is lowered to the best one the host supports
+void metric_force_isa(MetricIsa isa);
+
+#endif // METRICS_H
@@ -0,0 +1,90 @@
+#include "resample.h"
+#include "metrics.h"
+#include <immintrin.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+// acc[i] += row[i] for count bytes
+typedef void (*AccumulateRow_t)(const uint8_t* row, int count, uint32_t* acc);
+
+static void accumulate_row_scalar(const uint8_t* row, int count, uint32_t* acc) {
+    for (int i = 0; i < count; i++) {
+        acc[i] += row[i];
+    }
+}
+
+__attribute__((target("avx2")))
+static void accumulate_row_avx2(const uint8_t* row, int count, uint32_t* acc) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i px = _mm_loadu_si128((const __m128i*)(row + i));
+        __m256i lo = _mm256_cvtepu8_epi32(px);
+        __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(px, 8));
+        _mm256_storeu_si256((__m256i*)(acc + i), _mm256_add_epi32(_mm256_loadu_si256((__m256i*)(acc + i)), lo));
+        _mm256_storeu_si256((__m256i*)(acc + i + 8), _mm256_add_epi32(_mm256_loadu_si256((__m256i*)(acc + i + 8)), hi));
+    }
+    accumulate_row_scalar(row + i, count - i, acc + i);
+}
+
+__attribute__((target("avx512f")))
+static void accumulate_row_avx512(const uint8_t* row, int count, uint32_t* acc) {
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m512i lo = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(row + i)));
+        __m512i hi = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(row + i + 16)));
+        _mm512_storeu_si512(acc + i, _mm512_add_epi32(_mm512_loadu_si512(acc + i), lo));
+        _mm512_storeu_si512(acc + i + 16, _mm512_add_epi32(_mm512_loadu_si512(acc + i + 16), hi));
+    }
+    accumulate_row_scalar(row + i, count - i, acc + i);
+}
+
+void budget_size(int w, int h, long long pxBudget, int* pW, int* pH) {
+    double scale = std::sqrt(std::min(pxBudget/(double)((long long)w*h), (double)1.0));
+    *pW = std::max((int)(w * scale), 1);
+    *pH = std::max((int)(h * scale), 1);
+}
+
+// Separable: source rows of a destination row are summed per column with the vector
+// kernel, then column sums of each destination pixel are added 4 channels at a time.
+void resample_area(const uint8_t* src, int srcW, int srcH, int srcPitch,
+                   uint8_t* dst, int dstW, int dstH, int dstPitch) {
+    AccumulateRow_t accumulate = accumulate_row_scalar;
+    MetricIsa isa = metric_isa();
+    if (isa == METRIC_ISA_AVX512)
+        accumulate = accumulate_row_avx512;
+    else if (isa == METRIC_ISA_AVX2)
+        accumulate = accumulate_row_avx2;
+
+    // source column span of every destination column, same for all rows
+    std::vector<int> x0(dstW), x1(dstW);
+    for (int x = 0; x < dstW; x++) {
+        x0[x] = (int)((long long)x * srcW / dstW);
+        x1[x] = std::max((int)((long long)(x + 1) * srcW / dstW), x0[x] + 1);
+    }
+
+    std::vector<uint32_t> colSum((size_t)srcW * 4);
+    for (int y = 0; y < dstH; y++) {
+        int y0 = (int)((long long)y * srcH / dstH);
+        int y1 = std::max((int)((long long)(y + 1) * srcH / dstH), y0 + 1);
+
+        std::fill(colSum.begin(), colSum.end(), 0);
+        for (int sy = y0; sy < y1; sy++) {
+            accumulate(src + (size_t)sy * srcPitch, srcW * 4, colSum.data());
+        }
+
+        uint8_t* out = dst + (size_t)y * dstPitch;
+        for (int x = 0; x < dstW; x++) {
+            __m128i sum = _mm_setzero_si128();
+            for (int sx = x0[x]; sx < x1[x]; sx++) {
+                sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i*)(colSum.data() + sx * 4)));
+            }
+            uint32_t acc[4];
+            _mm_storeu_si128((__m128i*)acc, sum);
+            uint32_t n = (x1[x] - x0[x]) * (y1 - y0);
+            for (int c = 0; c < 4; c++) {
+                out[x * 4 + c] = (acc[c] + n / 2) / n;
+            }
+        }
+    }
+}
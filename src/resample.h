@@ -0,0 +1,15 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+#include <stdint.h>
+
+/* Area-average (box) resampling of 32-bit pixels for downscaling.
+   Each destination pixel averages the source pixels its footprint covers,
+   so thin details fade instead of aliasing like nearest neighbour. */
+
+void resample_area(const uint8_t* src, int srcW, int srcH, int srcPitch,
+                   uint8_t* dst, int dstW, int dstH, int dstPitch);
+
+// Size load_images gives an image of w x h under a pixel budget, never upscales
+void budget_size(int w, int h, long long pxBudget, int* pW, int* pH);
+
+#endif // RESAMPLE_H
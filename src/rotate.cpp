@@ -16,6 +16,7 @@
 
 #include <immintrin.h>
 #include "utils.h"
+#include "metrics.h"
 
 #define BM_DATA_ADD_OFS(src,offset) ((RotatePixel_t *)(((char*)(src)) + (offset)))
 
@@ -522,37 +523,424 @@ void RotateDrawClipExt1D
     }
 }
 
-void RotateDrawClipExt2
+static inline int64_t FloorDiv(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    return (q * b != a && ((a < 0) != (b < 0))) ? q - 1 : q;
+}
+
+static inline int64_t CeilDiv(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    return (q * b != a && ((a < 0) == (b < 0))) ? q + 1 : q;
+}
+
+/// <summary>
+/// Internal: Narrows [*pStart, *pEnd) to the steps k for which 0 <= (base + k * step) < limit.
+/// Exact in integers, so it matches per pixel bounds test of fixed point coordinates.
+/// </summary>
+static inline
+void RotateClipSpan(int base, int step, int64_t limit, int *pStart, int *pEnd)
+{
+    int64_t lo, hi; // inclusive
+
+    if (step == 0)
+    {
+        if (base < 0 || base >= limit) { *pEnd = *pStart; }
+        return;
+    }
+
+    if (step > 0)
+    {
+        lo = CeilDiv(-(int64_t)base, step);
+        hi = FloorDiv(limit - 1 - base, step);
+    }
+    else
+    {
+        lo = CeilDiv(limit - 1 - base, step);
+        hi = FloorDiv(-(int64_t)base, step);
+    }
+
+    if (lo > *pStart) { *pStart = lo < *pEnd ? (int)lo : *pEnd; }
+    if (hi + 1 < *pEnd) { *pEnd = hi + 1 > *pStart ? (int)(hi + 1) : *pStart; }
+}
+
+/// <summary>
+/// Internal: Copies count source samples stepped along the row into dstCurrent.
+/// All samples must land inside the source, so there is no bounds test. Vector variants
+/// step u/v in the same fixed point as the scalar loop, so output is pixel identical.
+/// The variant is picked at run time like the metric kernels (metric_isa), so a build
+/// without -mavx2/-mavx512f still gathers on hosts that have them.
+/// </summary>
+static
+void RotateCopyRowScalar
     (
-        RotatePixel_t *dst, int dstW, int dstH, int dstDelta,
-        RotatePixel_t *src, int srcW, int srcH, int srcDelta,
-        float ox, float oy,
-        float px, float py,
-        float angle, float scale,
-        RotateColorMergerFunc_t mergeFunc,
-        void *mergeParam
+        RotatePixel_t *dstCurrent,
+        const RotatePixel_t *src, int srcDelta,
+        int ui, int vi, int duRowi, int dvRowi,
+        int shift, int count
     )
 {
-    // Optimisation based on:
-    // https://github.com/wernsey/bitmap/blob/master/bmp.cpp
-    // Additional optimization inspired by:
-    // http://www.gamedev.ru/code/forum/?id=156842
-    // We assume that int is at least 32 bit integer here for all vars with i postfix
+    for (int x = 0; x < count; x++)
+    {
+        dstCurrent[x] = BM_GET(src, srcDelta, ui >> shift, vi >> shift);
+        ui += duRowi;
+        vi += dvRowi;
+    }
+}
 
-    angle = -angle; // to made rules consistent with RotateDrawWithClip
+__attribute__((target("avx2")))
+static
+void RotateCopyRowAvx2
+    (
+        RotatePixel_t *dstCurrent,
+        const RotatePixel_t *src, int srcDelta,
+        int ui, int vi, int duRowi, int dvRowi,
+        int shift, int count
+    )
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i stride = _mm256_set1_epi32(srcDelta / (int)sizeof(RotatePixel_t));
+    const __m256i ustep = _mm256_set1_epi32(duRowi * 8);
+    const __m256i vstep = _mm256_set1_epi32(dvRowi * 8);
 
-    if (dstW <= 0) { return; }
-    if (dstH <= 0) { return; }
+    __m256i uv = _mm256_add_epi32(_mm256_set1_epi32(ui), _mm256_mullo_epi32(lane, _mm256_set1_epi32(duRowi)));
+    __m256i vv = _mm256_add_epi32(_mm256_set1_epi32(vi), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dvRowi)));
 
-    int x,y;
+    for (int x = 0; x < count; x += 8)
+    {
+        __m256i m = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - x), lane);
+
+        __m256i uii = _mm256_sra_epi32(uv, sh);
+        __m256i vii = _mm256_sra_epi32(vv, sh);
+
+        __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(vii, stride), uii);
+        __m256i c = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)src, idx, m, 4);
+        _mm256_maskstore_epi32((int*)(dstCurrent + x), m, c);
+
+        uv = _mm256_add_epi32(uv, ustep);
+        vv = _mm256_add_epi32(vv, vstep);
+    }
+}
+
+__attribute__((target("avx512f")))
+static
+void RotateCopyRowAvx512
+    (
+        RotatePixel_t *dstCurrent,
+        const RotatePixel_t *src, int srcDelta,
+        int ui, int vi, int duRowi, int dvRowi,
+        int shift, int count
+    )
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i stride = _mm512_set1_epi32(srcDelta / (int)sizeof(RotatePixel_t));
+    const __m512i ustep = _mm512_set1_epi32(duRowi * 16);
+    const __m512i vstep = _mm512_set1_epi32(dvRowi * 16);
+
+    __m512i uv = _mm512_add_epi32(_mm512_set1_epi32(ui), _mm512_mullo_epi32(lane, _mm512_set1_epi32(duRowi)));
+    __m512i vv = _mm512_add_epi32(_mm512_set1_epi32(vi), _mm512_mullo_epi32(lane, _mm512_set1_epi32(dvRowi)));
+
+    for (int x = 0; x < count; x += 16)
+    {
+        __mmask16 m = (count - x >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << (count - x)) - 1);
 
+        __m512i uii = _mm512_sra_epi32(uv, sh);
+        __m512i vii = _mm512_sra_epi32(vv, sh);
+
+        __m512i idx = _mm512_add_epi32(_mm512_mullo_epi32(vii, stride), uii);
+        __m512i c = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, idx, src, 4);
+        _mm512_mask_storeu_epi32(dstCurrent + x, m, c);
+
+        uv = _mm512_add_epi32(uv, ustep);
+        vv = _mm512_add_epi32(vv, vstep);
+    }
+}
+
+static inline
+void RotateCopyRow
+    (
+        RotatePixel_t *dstCurrent,
+        const RotatePixel_t *src, int srcDelta,
+        int ui, int vi, int duRowi, int dvRowi,
+        int shift, int count
+    )
+{
+    MetricIsa isa = metric_isa();
+    if (isa == METRIC_ISA_AVX512)
+    {
+        RotateCopyRowAvx512(dstCurrent, src, srcDelta, ui, vi, duRowi, dvRowi, shift, count);
+    }
+    else if (isa == METRIC_ISA_AVX2)
+    {
+        RotateCopyRowAvx2(dstCurrent, src, srcDelta, ui, vi, duRowi, dvRowi, shift, count);
+    }
+    else
+    {
+        RotateCopyRowScalar(dstCurrent, src, srcDelta, ui, vi, duRowi, dvRowi, shift, count);
+    }
+}
+
+/// <summary>
+/// Internal: Fused sample and compare of count pixels along a row, the read-only twin of RotateCopyRow.
+/// Adds |target - source sample| to *pSrcSad and |target - canvas| to *pCanvasSad, bytewise.
+/// Samples are the ones RotateCopyRow would write, dispatched the same way.
+/// </summary>
+static
+void RotateSadRowScalar
+    (
+        const RotatePixel_t *target, const RotatePixel_t *canvas,
+        const RotatePixel_t *src, int srcDelta,
+        int ui, int vi, int duRowi, int dvRowi,
+        int shift, int count,
+        uint64_t *pSrcSad, uint64_t *pCanvasSad
+    )
+{
+    uint64_t srcSad = 0;
+    uint64_t canvasSad = 0;
+
+    for (int x = 0; x < count; x++)
+    {
+        RotatePixel_t c = BM_GET(src, srcDelta, ui >> shift, vi >> shift);
+        const uint8_t *t = (const uint8_t*)(target + x);
+        const uint8_t *n = (const uint8_t*)&c;
+        const uint8_t *o = (const uint8_t*)(canvas + x);
+
+        for (int b = 0; b < (int)sizeof(RotatePixel_t); b++)
+        {
+            srcSad += t[b] > n[b] ? t[b] - n[b] : n[b] - t[b];
+            canvasSad += t[b] > o[b] ? t[b] - o[b] : o[b] - t[b];
+        }
+
+        ui += duRowi;
+        vi += dvRowi;
+    }
+
+    *pSrcSad += srcSad;
+    *pCanvasSad += canvasSad;
+}
+
+__attribute__((target("avx2")))
+static
+void RotateSadRowAvx2
+    (
+        const RotatePixel_t *target, const RotatePixel_t *canvas,
+        const RotatePixel_t *src, int srcDelta,
+        int ui, int vi, int duRowi, int dvRowi,
+        int shift, int count,
+        uint64_t *pSrcSad, uint64_t *pCanvasSad
+    )
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i stride = _mm256_set1_epi32(srcDelta / (int)sizeof(RotatePixel_t));
+    const __m256i ustep = _mm256_set1_epi32(duRowi * 8);
+    const __m256i vstep = _mm256_set1_epi32(dvRowi * 8);
+
+    __m256i uv = _mm256_add_epi32(_mm256_set1_epi32(ui), _mm256_mullo_epi32(lane, _mm256_set1_epi32(duRowi)));
+    __m256i vv = _mm256_add_epi32(_mm256_set1_epi32(vi), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dvRowi)));
+    __m256i srcAcc = _mm256_setzero_si256();
+    __m256i canvasAcc = _mm256_setzero_si256();
+
+    for (int x = 0; x < count; x += 8)
+    {
+        // masked lanes read as zero in all three, so they add nothing
+        __m256i m = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - x), lane);
+
+        __m256i uii = _mm256_sra_epi32(uv, sh);
+        __m256i vii = _mm256_sra_epi32(vv, sh);
+
+        __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(vii, stride), uii);
+        __m256i c = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)src, idx, m, 4);
+        __m256i t = _mm256_maskload_epi32((const int*)(target + x), m);
+        __m256i o = _mm256_maskload_epi32((const int*)(canvas + x), m);
+
+        srcAcc = _mm256_add_epi64(srcAcc, _mm256_sad_epu8(t, c));
+        canvasAcc = _mm256_add_epi64(canvasAcc, _mm256_sad_epu8(t, o));
+
+        uv = _mm256_add_epi32(uv, ustep);
+        vv = _mm256_add_epi32(vv, vstep);
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, srcAcc);
+    *pSrcSad += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm256_storeu_si256((__m256i*)lanes, canvasAcc);
+    *pCanvasSad += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static
+void RotateSadRowAvx512
+    (
+        const RotatePixel_t *target, const RotatePixel_t *canvas,
+        const RotatePixel_t *src, int srcDelta,
+        int ui, int vi, int duRowi, int dvRowi,
+        int shift, int count,
+        uint64_t *pSrcSad, uint64_t *pCanvasSad
+    )
+{
+    const __m128i sh = _mm_cvtsi32_si128(shift);
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i stride = _mm512_set1_epi32(srcDelta / (int)sizeof(RotatePixel_t));
+    const __m512i ustep = _mm512_set1_epi32(duRowi * 16);
+    const __m512i vstep = _mm512_set1_epi32(dvRowi * 16);
+
+    __m512i uv = _mm512_add_epi32(_mm512_set1_epi32(ui), _mm512_mullo_epi32(lane, _mm512_set1_epi32(duRowi)));
+    __m512i vv = _mm512_add_epi32(_mm512_set1_epi32(vi), _mm512_mullo_epi32(lane, _mm512_set1_epi32(dvRowi)));
+    __m512i srcAcc = _mm512_setzero_si512();
+    __m512i canvasAcc = _mm512_setzero_si512();
+
+    for (int x = 0; x < count; x += 16)
+    {
+        __mmask16 m = (count - x >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << (count - x)) - 1);
+
+        __m512i uii = _mm512_sra_epi32(uv, sh);
+        __m512i vii = _mm512_sra_epi32(vv, sh);
+
+        __m512i idx = _mm512_add_epi32(_mm512_mullo_epi32(vii, stride), uii);
+        __m512i c = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, idx, src, 4);
+        __m512i t = _mm512_maskz_loadu_epi32(m, target + x);
+        __m512i o = _mm512_maskz_loadu_epi32(m, canvas + x);
+
+        srcAcc = _mm512_add_epi64(srcAcc, _mm512_sad_epu8(t, c));
+        canvasAcc = _mm512_add_epi64(canvasAcc, _mm512_sad_epu8(t, o));
+
+        uv = _mm512_add_epi32(uv, ustep);
+        vv = _mm512_add_epi32(vv, vstep);
+    }
+
+    *pSrcSad += _mm512_reduce_add_epi64(srcAcc);
+    *pCanvasSad += _mm512_reduce_add_epi64(canvasAcc);
+}
+
+static inline
+void RotateSadRow
+    (
+        const RotatePixel_t *target, const RotatePixel_t *canvas,
+        const RotatePixel_t *src, int srcDelta,
+        int ui, int vi, int duRowi, int dvRowi,
+        int shift, int count,
+        uint64_t *pSrcSad, uint64_t *pCanvasSad
+    )
+{
+    MetricIsa isa = metric_isa();
+    if (isa == METRIC_ISA_AVX512)
+    {
+        RotateSadRowAvx512(target, canvas, src, srcDelta, ui, vi, duRowi, dvRowi, shift, count, pSrcSad, pCanvasSad);
+    }
+    else if (isa == METRIC_ISA_AVX2)
+    {
+        RotateSadRowAvx2(target, canvas, src, srcDelta, ui, vi, duRowi, dvRowi, shift, count, pSrcSad, pCanvasSad);
+    }
+    else
+    {
+        RotateSadRowScalar(target, canvas, src, srcDelta, ui, vi, duRowi, dvRowi, shift, count, pSrcSad, pCanvasSad);
+    }
+}
+
+/// <summary>
+/// Internal: Draws one destination row of RotateDrawClipExt2 (no merge function).
+/// Row is first clipped analytically to the span that lands inside the source.
+/// </summary>
+static inline
+void RotateDrawRowSpan
+    (
+        RotatePixel_t *dstCurrent,
+        const RotatePixel_t *src, int srcW, int srcH, int srcDelta,
+        int ui, int vi, int duRowi, int dvRowi,
+        int shift, int count
+    )
+{
+    int start = 0;
+    int end = count;
+
+    RotateClipSpan(ui, duRowi, (int64_t)srcW << shift, &start, &end);
+    RotateClipSpan(vi, dvRowi, (int64_t)srcH << shift, &start, &end);
+
+    if (start >= end) { return; }
+
+    RotateCopyRow(dstCurrent + start, src, srcDelta,
+                  ui + start * duRowi, vi + start * dvRowi, duRowi, dvRowi,
+                  shift, end - start);
+}
+
+/// <summary>
+/// Internal: Same as RotateDrawRowSpan, but only pixels with clear bit in pCoverageRow are drawn
+/// and their bits are set afterwards. x0 is destination column of dstCurrent[0].
+/// Returns number of newly covered pixels.
+/// </summary>
+static inline
+int RotateDrawRowSpanCovered
+    (
+        RotatePixel_t *dstCurrent, int x0,
+        const RotatePixel_t *src, int srcW, int srcH, int srcDelta,
+        int ui, int vi, int duRowi, int dvRowi,
+        int shift, int count,
+        uint64_t *pCoverageRow
+    )
+{
+    int start = 0;
+    int end = count;
+
+    RotateClipSpan(ui, duRowi, (int64_t)srcW << shift, &start, &end);
+    RotateClipSpan(vi, dvRowi, (int64_t)srcH << shift, &start, &end);
+
+    if (start >= end) { return 0; }
+
+    int covered = 0;
+    int xs = x0 + start;
+    int xe = x0 + end; // exclusive
+
+    for (int w = xs >> 6; w <= (xe - 1) >> 6; w++)
+    {
+        int lo = w * 64 > xs ? w * 64 : xs;
+        int hi = w * 64 + 64 < xe ? w * 64 + 64 : xe;
+        uint64_t span = (hi - lo == 64) ? ~(uint64_t)0 : ((((uint64_t)1) << (hi - lo)) - 1) << (lo - w * 64);
+        uint64_t bits = span & ~pCoverageRow[w];
+
+        pCoverageRow[w] |= span;
+        covered += __builtin_popcountll(bits);
+
+        while (bits)
+        {
+            int runStart = __builtin_ctzll(bits);
+            uint64_t rest = ~(bits >> runStart);
+            int runLen = rest ? __builtin_ctzll(rest) : 64 - runStart;
+            int k = w * 64 + runStart - x0;
+
+            RotateCopyRow(dstCurrent + k, src, srcDelta,
+                          ui + k * duRowi, vi + k * dvRowi, duRowi, dvRowi,
+                          shift, runLen);
+
+            bits &= (runStart + runLen >= 64) ? 0 : (~(uint64_t)0 << (runStart + runLen));
+        }
+    }
+
+    return covered;
+}
+
+/// <summary>
+/// Internal: Computes destination bounding box (inclusive) scanned by RotateDrawClipExt2 style renderers.
+/// Angle must be already negated. Returns false if box does not intersect destination.
+/// </summary>
+static
+bool RotateClipBoundsInternal
+    (
+        int dstW, int dstH,
+        int srcW, int srcH,
+        float ox, float oy,
+        float px, float py,
+        float sinAngle, float cosAngle, float scale,
+        int *pMinX, int *pMinY, int *pMaxX, int *pMaxY
+    )
+{
     // fill min/max reverced (invalid) values at first
     int minx = dstW, miny = dstH;
     int maxx = 0, maxy = 0;
 
-    float sinAngle = sin(angle);
-    float cosAngle = cos(angle);
-
     float dx, dy;
     // Compute the position of where each corner on the source bitmap
     // will be on the destination to get a bounding box for scanning
@@ -590,6 +978,170 @@ void RotateDrawClipExt2
     if(miny < 0) { miny = 0; }
     if(maxy > dstH - 1) { maxy = dstH - 1; }
 
+    *pMinX = minx;
+    *pMinY = miny;
+    *pMaxX = maxx;
+    *pMaxY = maxy;
+
+    return minx <= maxx && miny <= maxy;
+}
+
+bool RotateGetClipBounds
+    (
+        int dstW, int dstH,
+        int srcW, int srcH,
+        float ox, float oy,
+        float px, float py,
+        float angle, float scale,
+        int *pMinX, int *pMinY, int *pMaxX, int *pMaxY
+    )
+{
+    angle = -angle; // to made rules consistent with RotateDrawWithClip
+
+    if (dstW <= 0 || dstH <= 0)
+    {
+        *pMinX = 0; *pMinY = 0; *pMaxX = -1; *pMaxY = -1;
+        return false;
+    }
+
+    return RotateClipBoundsInternal(dstW, dstH, srcW, srcH, ox, oy, px, py,
+                                    sin(angle), cos(angle), scale,
+                                    pMinX, pMinY, pMaxX, pMaxY);
+}
+
+bool RotateScoreClip
+    (
+        const RotatePixel_t *target, const RotatePixel_t *canvas, int dstW, int dstH, int dstDelta,
+        const RotatePixel_t *src, int srcW, int srcH, int srcDelta,
+        float ox, float oy,
+        float px, float py,
+        float angle, float scale,
+        uint64_t *pSrcSad, uint64_t *pCanvasSad
+    )
+{
+    angle = -angle; // to made rules consistent with RotateDrawWithClip
+
+    *pSrcSad = 0;
+    *pCanvasSad = 0;
+
+    if (dstW <= 0) { return false; }
+    if (dstH <= 0) { return false; }
+
+    int minx, miny;
+    int maxx, maxy;
+
+    float sinAngle = sin(angle);
+    float cosAngle = cos(angle);
+
+    if (!RotateClipBoundsInternal(dstW, dstH, srcW, srcH, ox, oy, px, py,
+                                  sinAngle, cosAngle, scale,
+                                  &minx, &miny, &maxx, &maxy))
+    {
+        return false;
+    }
+
+    // Same fixed point stepping as RotateDrawClipExt2Region, so the samples match the drawn pixels
+
+    int    ISCALE_SHIFT  = 16;
+    int    ISCALE_FACTOR = ((int)1) << (ISCALE_SHIFT);
+
+    float  dvCol = cosAngle / scale;
+    float  duCol = sinAngle / scale;
+
+    int    pxi = px * ISCALE_FACTOR;
+    int    pyi = py * ISCALE_FACTOR;
+
+    int    dvColi = dvCol * ISCALE_FACTOR;
+    int    duColi = duCol * ISCALE_FACTOR;
+    int    duRowi = dvColi;
+    int    dvRowi = -duColi;
+
+    int    startui = pxi - (ox * dvColi + oy * duColi);
+    int    startvi = pyi - (ox * dvRowi + oy * duRowi);
+
+    int    rowui = startui + miny * duColi;
+    int    rowvi = startvi + miny * dvColi;
+
+    bool covered = false;
+
+    for (int y = miny; y <= maxy; y++)
+    {
+        int ui = rowui + minx * duRowi;
+        int vi = rowvi + minx * dvRowi;
+
+        int start = 0;
+        int end = maxx - minx + 1;
+
+        RotateClipSpan(ui, duRowi, (int64_t)srcW << ISCALE_SHIFT, &start, &end);
+        RotateClipSpan(vi, dvRowi, (int64_t)srcH << ISCALE_SHIFT, &start, &end);
+
+        if (start < end)
+        {
+            const RotatePixel_t *targetCurrent = (const RotatePixel_t *)((const char*)target + y * dstDelta) + minx + start;
+            const RotatePixel_t *canvasCurrent = (const RotatePixel_t *)((const char*)canvas + y * dstDelta) + minx + start;
+
+            RotateSadRow(targetCurrent, canvasCurrent, src, srcDelta,
+                         ui + start * duRowi, vi + start * dvRowi, duRowi, dvRowi,
+                         ISCALE_SHIFT, end - start,
+                         pSrcSad, pCanvasSad);
+            covered = true;
+        }
+
+        rowui += duColi;
+        rowvi += dvColi;
+    }
+
+    return covered;
+}
+
+/// <summary>
+/// Internal: RotateDrawClipExt2 limited to [clipMinX..clipMaxX] x [clipMinY..clipMaxY] (inclusive) of destination.
+/// Pixels inside the clip region are identical to the ones drawn without clipping.
+/// If pCoverage is given (no merge function only), already covered pixels are skipped, see RotateDrawClipRegionCovered.
+/// </summary>
+static
+void RotateDrawClipExt2Region
+    (
+        RotatePixel_t *dst, int dstW, int dstH, int dstDelta,
+        RotatePixel_t *src, int srcW, int srcH, int srcDelta,
+        float ox, float oy,
+        float px, float py,
+        float angle, float scale,
+        RotateColorMergerFunc_t mergeFunc,
+        void *mergeParam,
+        int clipMinX, int clipMinY, int clipMaxX, int clipMaxY,
+        uint64_t *pCoverage, int coverageWords, int *pCovered
+    )
+{
+    // Optimisation based on:
+    // https://github.com/wernsey/bitmap/blob/master/bmp.cpp
+    // Additional optimization inspired by:
+    // http://www.gamedev.ru/code/forum/?id=156842
+    // We assume that int is at least 32 bit integer here for all vars with i postfix
+
+    angle = -angle; // to made rules consistent with RotateDrawWithClip
+
+    if (dstW <= 0) { return; }
+    if (dstH <= 0) { return; }
+
+    int x,y;
+
+    int minx, miny;
+    int maxx, maxy;
+
+    float sinAngle = sin(angle);
+    float cosAngle = cos(angle);
+
+    RotateClipBoundsInternal(dstW, dstH, srcW, srcH, ox, oy, px, py,
+                             sinAngle, cosAngle, scale,
+                             &minx, &miny, &maxx, &maxy);
+
+    // Region clipping (int stepping below is exact, so starting later does not change pixels)
+    if(minx < clipMinX) { minx = clipMinX; }
+    if(maxx > clipMaxX) { maxx = clipMaxX; }
+    if(miny < clipMinY) { miny = clipMinY; }
+    if(maxy > clipMaxY) { maxy = clipMaxY; }
+
     #if DEBUG_DRAW
     //minx = 0;
     //miny = 0;
@@ -686,6 +1238,22 @@ void RotateDrawClipExt2
         dstCurrent += minx;
         #endif
 
+        #if !DEBUG_DRAW && defined(OPT_DST_ADDR)
+        if (mergeFunc == NULL && pCoverage != NULL)
+        {
+            *pCovered += RotateDrawRowSpanCovered(dstCurrent, minx, src, srcW, srcH, srcDelta,
+                                                  ui, vi, duRowi, dvRowi,
+                                                  ISCALE_SHIFT, maxx - minx + 1,
+                                                  pCoverage + (size_t)y * coverageWords);
+        }
+        else if (mergeFunc == NULL)
+        {
+            RotateDrawRowSpan(dstCurrent, src, srcW, srcH, srcDelta,
+                              ui, vi, duRowi, dvRowi,
+                              ISCALE_SHIFT, maxx - minx + 1);
+        }
+        else
+        #endif
         for(x = minx; x <= maxx; x++)
         {
             int uii = ui >> ISCALE_SHIFT;
@@ -811,6 +1379,30 @@ void RotateDrawClipExt2
     #endif
 }
 
+void RotateDrawClipExt2
+    (
+        RotatePixel_t *dst, int dstW, int dstH, int dstDelta,
+        RotatePixel_t *src, int srcW, int srcH, int srcDelta,
+        float ox, float oy,
+        float px, float py,
+        float angle, float scale,
+        RotateColorMergerFunc_t mergeFunc,
+        void *mergeParam
+    )
+{
+    RotateDrawClipExt2Region
+    (
+        dst, dstW, dstH, dstDelta,
+        src, srcW, srcH, srcDelta,
+        ox, oy,
+        px, py,
+        angle, scale,
+        mergeFunc, mergeParam,
+        0, 0, dstW - 1, dstH - 1,
+        NULL, 0, NULL
+    );
+}
+
 sadPair RotateDrawClipSad
     (
         RotatePixel_t *dst, int dstW, int dstH, int dstDelta,
@@ -1177,3 +1769,54 @@ void RotateDrawClipExt
         mergeParam
     );
 }
+
+void RotateDrawClipRegion
+(
+    RotatePixel_t* pDstBase, int dstW, int dstH, int dstDelta,
+    RotatePixel_t* pSrcBase, int srcW, int srcH, int srcDelta,
+    float fDstRotCenterX, float fDstRotCenterY,
+    float fSrcRotCenterX, float fSrcRotCenterY,
+    float fAngle, float fScale,
+    int clipMinX, int clipMinY, int clipMaxX, int clipMaxY
+)
+{
+    RotateDrawClipExt2Region
+    (
+        pDstBase, dstW, dstH, dstDelta,
+        pSrcBase, srcW, srcH, srcDelta,
+        fDstRotCenterX, fDstRotCenterY,
+        fSrcRotCenterX, fSrcRotCenterY,
+        fAngle, fScale,
+        NULL, NULL,
+        clipMinX, clipMinY, clipMaxX, clipMaxY,
+        NULL, 0, NULL
+    );
+}
+
+int RotateDrawClipRegionCovered
+(
+    RotatePixel_t* pDstBase, int dstW, int dstH, int dstDelta,
+    RotatePixel_t* pSrcBase, int srcW, int srcH, int srcDelta,
+    float fDstRotCenterX, float fDstRotCenterY,
+    float fSrcRotCenterX, float fSrcRotCenterY,
+    float fAngle, float fScale,
+    int clipMinX, int clipMinY, int clipMaxX, int clipMaxY,
+    uint64_t* pCoverage, int coverageWords
+)
+{
+    int covered = 0;
+
+    RotateDrawClipExt2Region
+    (
+        pDstBase, dstW, dstH, dstDelta,
+        pSrcBase, srcW, srcH, srcDelta,
+        fDstRotCenterX, fDstRotCenterY,
+        fSrcRotCenterX, fSrcRotCenterY,
+        fAngle, fScale,
+        NULL, NULL,
+        clipMinX, clipMinY, clipMaxX, clipMaxY,
+        pCoverage, coverageWords, &covered
+    );
+
+    return covered;
+}
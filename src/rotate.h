@@ -130,6 +130,78 @@ void RotateDrawClipExt
     void* mergeParam ROTATE_DEF_PARAM(NULL)
 );
 
+/// <summary>
+/// Same as RotateDrawClip, but only destination pixels inside the clip region are touched.
+/// Pixels inside the region are identical to the ones RotateDrawClip would draw.
+/// </summary>
+/// <param name="clipMinX">Clip region left column (inclusive)</param>
+/// <param name="clipMinY">Clip region top row (inclusive)</param>
+/// <param name="clipMaxX">Clip region right column (inclusive)</param>
+/// <param name="clipMaxY">Clip region bottom row (inclusive)</param>
+extern
+void RotateDrawClipRegion
+(
+    RotatePixel_t* pDstBase, int dstW, int dstH, int dstDelta,
+    RotatePixel_t* pSrcBase, int srcW, int srcH, int srcDelta,
+    float fDstRotCenterX, float fDstRotCenterY,
+    float fSrcRotCenterX, float fSrcRotCenterY,
+    float fAngle, float fScale,
+    int clipMinX, int clipMinY, int clipMaxX, int clipMaxY
+);
+
+/// <summary>
+/// Front-to-back variant of RotateDrawClipRegion.
+/// Only pixels whose coverage bit is clear are drawn, then their bits are set.
+/// </summary>
+/// <param name="pCoverage">Coverage bitmask, bit (x % 64) of word (y * coverageWords + x / 64) is pixel (x, y)</param>
+/// <param name="coverageWords">Number of 64-bit coverage words per destination row</param>
+/// <returns>Number of newly covered pixels</returns>
+extern
+int RotateDrawClipRegionCovered
+(
+    RotatePixel_t* pDstBase, int dstW, int dstH, int dstDelta,
+    RotatePixel_t* pSrcBase, int srcW, int srcH, int srcDelta,
+    float fDstRotCenterX, float fDstRotCenterY,
+    float fSrcRotCenterX, float fSrcRotCenterY,
+    float fAngle, float fScale,
+    int clipMinX, int clipMinY, int clipMaxX, int clipMaxY,
+    uint64_t* pCoverage, int coverageWords
+);
+
+/// <summary>
+/// Computes destination bounding box (inclusive, clipped to destination) that RotateDrawClip scans.
+/// Returns false if nothing would be drawn.
+/// </summary>
+extern
+bool RotateGetClipBounds
+(
+    int dstW, int dstH,
+    int srcW, int srcH,
+    float fDstRotCenterX, float fDstRotCenterY,
+    float fSrcRotCenterX, float fSrcRotCenterY,
+    float fAngle, float fScale,
+    int *pMinX, int *pMinY, int *pMaxX, int *pMaxY
+);
+
+/// <summary>
+/// Scores a RotateDrawClip of source without drawing it. Over the destination pixels the draw
+/// would cover, sums |target - source sample| and |target - canvas| bytewise in one pass.
+/// Target and canvas share the destination size and stride.
+/// Returns false if no pixel would be covered.
+/// </summary>
+/// <param name="pSrcSad">Receives SAD of target against the rotated source</param>
+/// <param name="pCanvasSad">Receives SAD of target against canvas under the same pixels</param>
+extern
+bool RotateScoreClip
+(
+    const RotatePixel_t* pTarget, const RotatePixel_t* pCanvas, int dstW, int dstH, int dstDelta,
+    const RotatePixel_t* pSrcBase, int srcW, int srcH, int srcDelta,
+    float fDstRotCenterX, float fDstRotCenterY,
+    float fSrcRotCenterX, float fSrcRotCenterY,
+    float fAngle, float fScale,
+    uint64_t *pSrcSad, uint64_t *pCanvasSad
+);
+
 // Individual versions
 // --------------------------------------------------------
 // (different implemenation alogorithms) -- for test only
@@ -3,12 +3,13 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
+#include "metrics.h"
 
 /* Img utils */
 typedef struct SrcImage {
-    uint16_t width;
-    uint16_t height;
-    uint16_t pitch;
+    int width;
+    int height;
+    int pitch; // bytes, 16 bits wrap for full resolution photos
     uint32_t sad;
     std::string path;
     uint8_t* data;
@@ -16,13 +17,6 @@ typedef struct SrcImage {
 
 void load_images(int px_per_image, std::string path, std::vector<SrcImage>&images);
 
-/* Math utils */
-int compute_sad(uint8_t* image, uint8_t* target, size_t num_bytes);
-int compute_sad_naive(uint8_t* image, uint8_t* target, size_t num_bytes);
-uint64_t compute_sse_naive(uint8_t* image, uint8_t* target, size_t num_bytes);
-void simd_memcpy(uint8_t* dst, uint8_t* src, size_t num_bytes);
-
-uint8_t* SobelSimd(uint8_t* inputImage, int width, int height, int pitch);
-uint8_t* to_greyscale(uint8_t* inputImage, int width, int height, int pitch);
+/* Metric kernels live in metrics.h, edge maps in edges.h */
 
 #endif // UTILS_H